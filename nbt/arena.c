@@ -0,0 +1,203 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  arena.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "internal.h"
+
+/* Slabs are aligned to their size, so masking any pointer into one finds its header */
+#define NBT_ARENA_SLAB (64 * 1024)
+
+/* Anything bigger gets a block of its own instead of wasting the end of a slab */
+#define NBT_ARENA_LARGE (NBT_ARENA_SLAB / 4)
+
+#define NBT_ARENA_ALIGN 16
+
+typedef struct nbt_arena_slab nbt_arena_slab_t;
+
+struct nbt_arena_slab {
+	nbt_arena_t* arena;
+	nbt_arena_slab_t* next;
+};
+
+/* Large blocks are plain malloc and are never masked, so they only need a link */
+typedef struct nbt_arena_block nbt_arena_block_t;
+
+struct nbt_arena_block {
+	nbt_arena_block_t* next;
+	char data[] __attribute__((aligned(NBT_ARENA_ALIGN)));
+};
+
+/* Lives at the start of the first slab */
+struct nbt_arena {
+	nbt_arena_slab_t* slabs;
+	nbt_arena_block_t* blocks;
+	char* cursor;
+	char* end;
+	bool mixed;
+	nbt_source_t* source;	/* a lazy tree's input, its arena nodes don't count themselves */
+};
+
+nbt_arena_slab_t* _nbt_arena_slab(nbt_arena_t* arena);
+
+static inline size_t _nbt_arena_round(size_t size) {
+	return (size + NBT_ARENA_ALIGN - 1) & ~(size_t)(NBT_ARENA_ALIGN - 1);
+}
+
+nbt_arena_t* _nbt_arena_create() {
+	void* memory = NULL;
+	int ret = posix_memalign(&memory, NBT_ARENA_SLAB, NBT_ARENA_SLAB);
+	assert(!ret && memory);
+	(void)ret;
+	nbt_arena_slab_t* slab = memory;
+	nbt_arena_t* arena = (nbt_arena_t*)((char*)memory + _nbt_arena_round(sizeof(*slab)));
+	slab->arena = arena;
+	slab->next = NULL;
+	arena->slabs = slab;
+	arena->blocks = NULL;
+	arena->cursor = (char*)arena + _nbt_arena_round(sizeof(*arena));
+	arena->end = (char*)memory + NBT_ARENA_SLAB;
+	arena->mixed = false;
+	arena->source = NULL;
+	return arena;
+}
+
+void _nbt_arena_release(nbt_arena_t* arena) {
+	if (arena->source) {
+		_nbt_source_release(arena->source);
+	}
+	nbt_arena_block_t* block = arena->blocks;
+	while (block) {
+		nbt_arena_block_t* next = block->next;
+		free(block);
+		block = next;
+	}
+	/* The arena itself is in the last slab on the list */
+	nbt_arena_slab_t* slab = arena->slabs;
+	while (slab) {
+		nbt_arena_slab_t* next = slab->next;
+		free(slab);
+		slab = next;
+	}
+}
+
+void* _nbt_arena_alloc(nbt_arena_t* arena, size_t size) {
+	size = _nbt_arena_round(size);
+	if (size > NBT_ARENA_LARGE) {
+		nbt_arena_block_t* block = malloc(sizeof(*block) + size);
+		assert(block);
+		block->next = arena->blocks;
+		arena->blocks = block;
+		return block->data;
+	}
+	if ((size_t)(arena->end - arena->cursor) < size) {
+		nbt_arena_slab_t* slab = _nbt_arena_slab(arena);
+		arena->cursor = (char*)slab + _nbt_arena_round(sizeof(*slab));
+		arena->end = (char*)slab + NBT_ARENA_SLAB;
+	}
+	void* pointer = arena->cursor;
+	arena->cursor += size;
+	return pointer;
+}
+
+void* _nbt_arena_block_create(size_t size) {
+	nbt_arena_block_t* block = malloc(sizeof(*block) + size);
+	assert(block);
+	block->next = NULL;
+	return block->data;
+}
+
+void _nbt_arena_block_release(void* data) {
+	free((char*)data - offsetof(nbt_arena_block_t, data));
+}
+
+void _nbt_arena_attach(nbt_arena_t* arena, void* data) {
+	nbt_arena_block_t* block = (nbt_arena_block_t*)((char*)data - offsetof(nbt_arena_block_t, data));
+	/* Readers on other threads can be attaching at the same time */
+	block->next = __atomic_load_n(&arena->blocks, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&arena->blocks, &block->next, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+nbt_arena_t* _nbt_arena_of(const void* pointer) {
+	const nbt_arena_slab_t* slab = (const nbt_arena_slab_t*)((uintptr_t)pointer & ~(uintptr_t)(NBT_ARENA_SLAB - 1));
+	return slab->arena;
+}
+
+void _nbt_arena_mix(nbt_arena_t* arena) {
+	arena->mixed = true;
+}
+
+bool _nbt_arena_mixed(nbt_arena_t* arena) {
+	return arena->mixed;
+}
+
+void _nbt_arena_keep(nbt_arena_t* arena, nbt_source_t* source) {
+	assert(!arena->source);
+	_nbt_source_retain(source);
+	arena->source = source;
+}
+
+void _nbt_arena_adopt(nbt_arena_t* arena, nbt_arena_t* other) {
+	assert(!other->source);
+	/* other lives in its own first slab, so everything it says has to be read before that slab is arena's */
+	nbt_arena_slab_t* slabs = other->slabs;
+	nbt_arena_block_t* blocks = other->blocks;
+	arena->mixed |= other->mixed;
+	nbt_arena_slab_t* slab = slabs;
+	for (;;) {
+		slab->arena = arena;
+		if (!slab->next) {
+			break;
+		}
+		slab = slab->next;
+	}
+	/* In front, arena's own first slab stays last */
+	slab->next = arena->slabs;
+	arena->slabs = slabs;
+	if (blocks) {
+		nbt_arena_block_t* block = blocks;
+		while (block->next) {
+			block = block->next;
+		}
+		block->next = arena->blocks;
+		arena->blocks = blocks;
+	}
+}
+
+nbt_arena_slab_t* _nbt_arena_slab(nbt_arena_t* arena) {
+	void* memory = NULL;
+	int ret = posix_memalign(&memory, NBT_ARENA_SLAB, NBT_ARENA_SLAB);
+	assert(!ret && memory);
+	(void)ret;
+	nbt_arena_slab_t* slab = memory;
+	slab->arena = arena;
+	/* Keep the first slab (which holds the arena) last so it's freed last */
+	slab->next = arena->slabs;
+	arena->slabs = slab;
+	return slab;
+}
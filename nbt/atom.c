@@ -0,0 +1,124 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  atom.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+#include <pthread.h>
+
+/* Atoms are never freed, so only names that look like keys get one */
+#define NBT_ATOM_MAX_LENGTH 64
+#define NBT_ATOM_LIMIT (64 * 1024)
+
+/* Every thread's atoms come from here, the contexts keep their own copy of what they've seen */
+static struct {
+	pthread_mutex_t lock;
+	size_t count;
+	size_t mask;
+	struct nbt_atom** slots;
+} _nbt_atoms = { PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL };
+
+struct nbt_atom** _nbt_atom_slot(struct nbt_atom** slots, size_t mask, const char* name, size_t length, uint32_t hash);
+void _nbt_atom_grow(struct nbt_atom*** slots, size_t* mask);
+const char* _nbt_atom_global(const char* name, size_t length, uint32_t hash);
+
+const char* nbt_intern(const char* name) {
+	size_t length = strlen(name);
+	return _nbt_atom_global(name, length, _nbt_hash_bytes(name, length));
+}
+
+const char* _nbt_context_atom(nbt_context_t* context, const char* name, size_t length) {
+	if (length > NBT_ATOM_MAX_LENGTH) {
+		return NULL;
+	}
+	uint32_t hash = _nbt_hash_bytes(name, length);
+	if ((context->atoms_count + 1) * 2 > context->atoms_mask + 1) {
+		_nbt_atom_grow(&context->atoms, &context->atoms_mask);
+	}
+	struct nbt_atom** slot = _nbt_atom_slot(context->atoms, context->atoms_mask, name, length, hash);
+	if (*slot) {
+		return (*slot)->name;
+	}
+	const char* atom = _nbt_atom_global(name, length, hash);
+	if (atom) {
+		*slot = _nbt_atom_of(atom);
+		context->atoms_count++;
+	}
+	return atom;
+}
+
+const char* _nbt_atom_global(const char* name, size_t length, uint32_t hash) {
+	if (length > NBT_ATOM_MAX_LENGTH) {
+		return NULL;
+	}
+	const char* atom = NULL;
+	pthread_mutex_lock(&_nbt_atoms.lock);
+	if ((_nbt_atoms.count + 1) * 2 > _nbt_atoms.mask + 1) {
+		_nbt_atom_grow(&_nbt_atoms.slots, &_nbt_atoms.mask);
+	}
+	struct nbt_atom** slot = _nbt_atom_slot(_nbt_atoms.slots, _nbt_atoms.mask, name, length, hash);
+	if (*slot) {
+		atom = (*slot)->name;
+	} else if (_nbt_atoms.count < NBT_ATOM_LIMIT) {
+		struct nbt_atom* created = malloc(sizeof(*created) + length + 1);
+		created->hash = hash;
+		created->length = (uint32_t)length;
+		memcpy(created->name, name, length);
+		created->name[length] = '\0';
+		*slot = created;
+		_nbt_atoms.count++;
+		atom = created->name;
+	}
+	pthread_mutex_unlock(&_nbt_atoms.lock);
+	return atom;
+}
+
+/* The slot holding the atom for name, or the empty slot it would go in */
+struct nbt_atom** _nbt_atom_slot(struct nbt_atom** slots, size_t mask, const char* name, size_t length, uint32_t hash) {
+	size_t i = hash & mask;
+	while (slots[i] && (slots[i]->hash != hash || slots[i]->length != length || memcmp(slots[i]->name, name, length))) {
+		i = (i + 1) & mask;
+	}
+	return &slots[i];
+}
+
+void _nbt_atom_grow(struct nbt_atom*** slots, size_t* mask) {
+	size_t capacity = *slots ? (*mask + 1) * 2 : 64;
+	struct nbt_atom** grown = calloc(capacity, sizeof(*grown));
+	if (*slots) {
+		for (size_t i = 0; i <= *mask; i++) {
+			struct nbt_atom* atom = (*slots)[i];
+			if (atom) {
+				*_nbt_atom_slot(grown, capacity - 1, atom->name, atom->length, atom->hash) = atom;
+			}
+		}
+		free(*slots);
+	}
+	*slots = grown;
+	*mask = capacity - 1;
+}
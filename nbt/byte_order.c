@@ -29,9 +29,18 @@
 
 #include "byte_order.h"
 
+#include <stdint.h>
 #include <string.h>
 #include <sys/param.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define NBT_SWAP_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NBT_SWAP_NEON 1
+#include <arm_neon.h>
+#endif
+
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 nbt_byte_order_t nbt_native_byte_order = NBT_LITTLE_ENDIAN;
 #elif __BYTE_ORDER == __BIG_ENDIAN
@@ -40,6 +49,32 @@ nbt_byte_order_t nbt_native_byte_order = NBT_BIG_ENDIAN;
 #error You seem to be compiling for an unknown byte order.
 #endif
 
+/* Swaps count elements of width bytes each */
+typedef void (*nbt_swap_kernel_t)(void* dst, const void* src, size_t count, size_t width);
+
+void _nbt_swap_scalar(void* dst, const void* src, size_t count, size_t width);
+#if NBT_SWAP_X86
+void _nbt_swap_ssse3(void* dst, const void* src, size_t count, size_t width);
+void _nbt_swap_avx2(void* dst, const void* src, size_t count, size_t width);
+#elif NBT_SWAP_NEON
+void _nbt_swap_neon(void* dst, const void* src, size_t count, size_t width);
+#endif
+void _nbt_swap_bulk(void* dst, const void* src, size_t count, size_t width);
+
+/* Picked on first use */
+static nbt_swap_kernel_t _nbt_swap_kernel = NULL;
+
+#if NBT_SWAP_X86
+/* pshufb controls reversing each 2, 4 and 8 byte group of a 16 byte lane */
+static const int8_t _nbt_swap_masks[3][16] = {
+	{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+	{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+	{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+};
+
+#define NBT_SWAP_MASK(width) _nbt_swap_masks[(width) == 2 ? 0 : (width) == 4 ? 1 : 2]
+#endif
+
 void nbt_swap(void* data, size_t length) {
 	int8_t* original = (int8_t*)data;
 	int8_t temp[length];
@@ -120,3 +155,149 @@ double nbt_reorder_double(double value, nbt_byte_order_t byte_order) {
 		return value;
 	}
 }
+
+void nbt_swap_shorts(void* dst, const void* src, size_t count) {
+	_nbt_swap_bulk(dst, src, count, sizeof(int16_t));
+}
+
+void nbt_swap_ints(void* dst, const void* src, size_t count) {
+	_nbt_swap_bulk(dst, src, count, sizeof(int32_t));
+}
+
+void nbt_swap_longs(void* dst, const void* src, size_t count) {
+	_nbt_swap_bulk(dst, src, count, sizeof(int64_t));
+}
+
+void nbt_reorder_shorts(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order) {
+	if (byte_order != nbt_native_byte_order) {
+		nbt_swap_shorts(dst, src, count);
+	} else if (dst != src) {
+		memmove(dst, src, count * sizeof(int16_t));
+	}
+}
+
+void nbt_reorder_ints(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order) {
+	if (byte_order != nbt_native_byte_order) {
+		nbt_swap_ints(dst, src, count);
+	} else if (dst != src) {
+		memmove(dst, src, count * sizeof(int32_t));
+	}
+}
+
+void nbt_reorder_longs(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order) {
+	if (byte_order != nbt_native_byte_order) {
+		nbt_swap_longs(dst, src, count);
+	} else if (dst != src) {
+		memmove(dst, src, count * sizeof(int64_t));
+	}
+}
+
+void _nbt_swap_bulk(void* dst, const void* src, size_t count, size_t width) {
+	/* Parallel writes and parses swap from any thread, so the pick is published atomically */
+	nbt_swap_kernel_t kernel = __atomic_load_n(&_nbt_swap_kernel, __ATOMIC_ACQUIRE);
+	if (!kernel) {
+		kernel = _nbt_swap_scalar;
+#if NBT_SWAP_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			kernel = _nbt_swap_avx2;
+		} else if (__builtin_cpu_supports("ssse3")) {
+			kernel = _nbt_swap_ssse3;
+		}
+#elif NBT_SWAP_NEON
+		kernel = _nbt_swap_neon;
+#endif
+		/* Every thread picks the same kernel, so whichever store lands last doesn't matter */
+		__atomic_store_n(&_nbt_swap_kernel, kernel, __ATOMIC_RELEASE);
+	}
+	kernel(dst, src, count, width);
+}
+
+void _nbt_swap_scalar(void* dst, const void* src, size_t count, size_t width) {
+	uint8_t* out = dst;
+	const uint8_t* in = src;
+	switch (width) {
+		case sizeof(uint16_t):
+			for (size_t i = 0; i < count; i++, in += width, out += width) {
+				uint16_t value;
+				memcpy(&value, in, width);
+				value = __builtin_bswap16(value);
+				memcpy(out, &value, width);
+			}
+			break;
+		case sizeof(uint32_t):
+			for (size_t i = 0; i < count; i++, in += width, out += width) {
+				uint32_t value;
+				memcpy(&value, in, width);
+				value = __builtin_bswap32(value);
+				memcpy(out, &value, width);
+			}
+			break;
+		case sizeof(uint64_t):
+			for (size_t i = 0; i < count; i++, in += width, out += width) {
+				uint64_t value;
+				memcpy(&value, in, width);
+				value = __builtin_bswap64(value);
+				memcpy(out, &value, width);
+			}
+			break;
+	}
+}
+
+#if NBT_SWAP_X86
+__attribute__((target("ssse3")))
+void _nbt_swap_ssse3(void* dst, const void* src, size_t count, size_t width) {
+	uint8_t* out = dst;
+	const uint8_t* in = src;
+	const __m128i mask = _mm_loadu_si128((const __m128i*)NBT_SWAP_MASK(width));
+	size_t per_block = 16 / width;
+	for (; count >= per_block; count -= per_block, in += 16, out += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i*)in);
+		_mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(block, mask));
+	}
+	_nbt_swap_scalar(out, in, count, width);
+}
+
+__attribute__((target("avx2")))
+void _nbt_swap_avx2(void* dst, const void* src, size_t count, size_t width) {
+	uint8_t* out = dst;
+	const uint8_t* in = src;
+	/* vpshufb shuffles within each 128 bit lane, so the same control works twice over */
+	const __m128i lane = _mm_loadu_si128((const __m128i*)NBT_SWAP_MASK(width));
+	const __m256i mask = _mm256_broadcastsi128_si256(lane);
+	size_t per_block = 32 / width;
+	for (; count >= 2 * per_block; count -= 2 * per_block, in += 64, out += 64) {
+		__m256i first = _mm256_loadu_si256((const __m256i*)in);
+		__m256i second = _mm256_loadu_si256((const __m256i*)(in + 32));
+		_mm256_storeu_si256((__m256i*)out, _mm256_shuffle_epi8(first, mask));
+		_mm256_storeu_si256((__m256i*)(out + 32), _mm256_shuffle_epi8(second, mask));
+	}
+	for (; count >= per_block; count -= per_block, in += 32, out += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i*)in);
+		_mm256_storeu_si256((__m256i*)out, _mm256_shuffle_epi8(block, mask));
+	}
+	_nbt_swap_scalar(out, in, count, width);
+}
+#elif NBT_SWAP_NEON
+void _nbt_swap_neon(void* dst, const void* src, size_t count, size_t width) {
+	uint8_t* out = dst;
+	const uint8_t* in = src;
+	size_t per_block = 16 / width;
+	for (; count >= per_block; count -= per_block, in += 16, out += 16) {
+		uint8x16_t block = vld1q_u8(in);
+		switch (width) {
+			case sizeof(uint16_t):
+				block = vrev16q_u8(block);
+				break;
+			case sizeof(uint32_t):
+				block = vrev32q_u8(block);
+				break;
+			default:
+				block = vrev64q_u8(block);
+				break;
+		}
+		vst1q_u8(out, block);
+	}
+	_nbt_swap_scalar(out, in, count, width);
+}
+#endif
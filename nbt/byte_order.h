@@ -54,6 +54,18 @@ int64_t nbt_reorder_long(int64_t value, nbt_byte_order_t byte_order);
 float nbt_reorder_float(float value, nbt_byte_order_t byte_order);
 double nbt_reorder_double(double value, nbt_byte_order_t byte_order);
 
+/*
+ * Bulk conversion of arrays of count elements. Uses SSSE3/AVX2 or NEON when
+ * the CPU has them. Neither buffer needs to be aligned and dst may equal src.
+ */
+void nbt_swap_shorts(void* dst, const void* src, size_t count);
+void nbt_swap_ints(void* dst, const void* src, size_t count);
+void nbt_swap_longs(void* dst, const void* src, size_t count);
+
+void nbt_reorder_shorts(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order);
+void nbt_reorder_ints(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order);
+void nbt_reorder_longs(void* dst, const void* src, size_t count, nbt_byte_order_t byte_order);
+
 __END_DECLS
 
 #endif /* byte_order_h */
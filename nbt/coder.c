@@ -28,22 +28,165 @@
  */
 
 #include "coder.h"
+#include "internal.h"
+#include "parallel.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <zlib.h>
 
 #define NBT_CODER_DEFAULT_CHUNK 128
+#define NBT_CODER_STREAM_WINDOW (64 * 1024)
+#define NBT_CODER_SINK_BUFFER (64 * 1024)
+#define NBT_CODER_DEFLATE_SPACE (4 * 1024)
+#define NBT_CODER_PARALLEL_BLOCK (128 * 1024)
+#define NBT_CODER_DICTIONARY (32 * 1024)
+
+/* The most a size hint reserves up front, output past it grows as it turns up */
+#define NBT_CODER_HINT_MAX (64 * 1024 * 1024)
+
+typedef enum {
+	NBT_CODER_OWNED,	/* malloc'd, grows on encode, freed on release */
+	NBT_CODER_MAPPED,	/* read only mmap of a file, unmapped on release */
+	NBT_CODER_BORROWED,	/* read only view of caller memory, never freed */
+	NBT_CODER_STREAM,	/* read only window refilled from a source */
+	NBT_CODER_SINK		/* append only buffer flushed to a destination */
+} nbt_coder_storage_t;
+
+typedef struct nbt_coder_stream nbt_coder_stream_t;
+
+struct nbt_coder_stream {
+	/* Read up to length bytes, 0 means the source is exhausted */
+	size_t (*read)(nbt_coder_stream_t* stream, char* buffer, size_t length);
+	void (*close)(nbt_coder_stream_t* stream);
+	union {
+		int fd;
+		FILE* fp;
+		struct {
+			z_stream z;
+			nbt_coder_t* source;
+			int status;
+		} inflate;
+	} source;
+};
+
+typedef struct nbt_coder_sink nbt_coder_sink_t;
+
+/* A writer thread empties one buffer while the coder fills the other */
+typedef struct {
+	int fd;
+	pthread_t thread;
+	bool started;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char* writing;	/* handed off and not written yet */
+	size_t writing_length;
+	char* spare;	/* written and free to fill again */
+	bool failed;
+	bool stop;
+} nbt_coder_fd_sink_t;
+
+struct nbt_coder_sink {
+	/* Consume data and then extra, false on failure */
+	bool (*write)(nbt_coder_sink_t* sink, const char* data, size_t length, const char* extra, size_t extra_length);
+	/* End the output once everything has been written, false on failure */
+	bool (*finish)(nbt_coder_sink_t* sink);
+	void (*close)(nbt_coder_sink_t* sink);
+	/*
+	 * Optional, for a full buffer: takes *buffer to write in the background
+	 * and swaps in an empty one, false if an earlier write has failed
+	 */
+	bool (*hand_off)(nbt_coder_sink_t* sink, char** buffer, size_t length);
+	bool finished;
+	union {
+		nbt_coder_fd_sink_t fd;
+		struct {
+			z_stream z;
+			nbt_coder_t* destination;
+		} deflate;
+	} destination;
+};
+
+/* One block of a parallel compression */
+typedef struct {
+	const Bytef* input;
+	size_t length;
+	Bytef* output;
+	size_t size;
+	uLong check;
+} nbt_coder_block_t;
+
+typedef struct {
+	nbt_coder_block_t* blocks;
+	size_t count;
+	nbt_compression_strategy_t compression_strategy;
+} nbt_coder_blocks_t;
 
 struct _nbt_coder {
 	char* data;
 	size_t size;
 	size_t cursor;
 	size_t reserved;
+	nbt_coder_storage_t storage;
+	nbt_coder_stream_t* stream;
+	nbt_coder_sink_t* sink;
+	bool failed;
 };
 
 void _nbt_coder_reserve(nbt_coder_t* coder, size_t reserved);
+bool _nbt_coder_try_reserve(nbt_coder_t* coder, size_t reserved);
+void _nbt_coder_refill(nbt_coder_t* coder, size_t length);
+size_t _nbt_coder_inflated_size(nbt_coder_t* coder);
+nbt_coder_t* _nbt_coder_decompress(nbt_coder_t* coder, size_t expected_size, size_t limit, nbt_status_t* errorp);
+void _nbt_coder_compress_block(void* context, size_t index);
+nbt_coder_t* _nbt_coder_create_stream(nbt_coder_stream_t* stream);
+
+size_t _nbt_coder_fd_read(nbt_coder_stream_t* stream, char* buffer, size_t length);
+size_t _nbt_coder_fp_read(nbt_coder_stream_t* stream, char* buffer, size_t length);
+size_t _nbt_coder_inflate_read(nbt_coder_stream_t* stream, char* buffer, size_t length);
+void _nbt_coder_inflate_close(nbt_coder_stream_t* stream);
+
+nbt_coder_t* _nbt_coder_create_sink(nbt_coder_sink_t* sink);
+void _nbt_coder_make_room(nbt_coder_t* coder, size_t length);
+void _nbt_coder_flush(nbt_coder_t* coder, const char* extra, size_t extra_length);
+void _nbt_coder_append_array(nbt_coder_t* coder, const void* items, size_t count, size_t width, nbt_byte_order_t order, void (*reorder)(void*, const void*, size_t, nbt_byte_order_t));
+bool _nbt_coder_fd_write(nbt_coder_sink_t* sink, const char* data, size_t length, const char* extra, size_t extra_length);
+bool _nbt_coder_fd_writev(int fd, const char* data, size_t length, const char* extra, size_t extra_length);
+bool _nbt_coder_fd_hand_off(nbt_coder_sink_t* sink, char** buffer, size_t length);
+bool _nbt_coder_fd_wait(nbt_coder_sink_t* sink);
+void _nbt_coder_fd_close(nbt_coder_sink_t* sink);
+void* _nbt_coder_fd_writer(void* argument);
+bool _nbt_coder_deflate_write(nbt_coder_sink_t* sink, const char* data, size_t length, const char* extra, size_t extra_length);
+bool _nbt_coder_deflate_finish(nbt_coder_sink_t* sink);
+void _nbt_coder_deflate_close(nbt_coder_sink_t* sink);
+bool _nbt_coder_deflate(nbt_coder_sink_t* sink, const char* data, size_t length, int flush);
+
+/* Make room if needed and hand back the end of the coder, moved past length bytes */
+static inline char* _nbt_coder_append(nbt_coder_t* coder, size_t length) {
+	if (coder->reserved - coder->size < length) {
+		_nbt_coder_make_room(coder, length);
+	}
+	char* end = coder->data + coder->size;
+	coder->size += length;
+	coder->cursor = coder->size;
+	return end;
+}
+
+/* Make sure length bytes past the cursor are readable */
+static inline void _nbt_coder_require(nbt_coder_t* coder, size_t length) {
+	if (coder->cursor + length > coder->size) {
+		_nbt_coder_refill(coder, length);
+	}
+	assert(coder->cursor + length <= coder->size);
+}
 
 nbt_coder_t* nbt_coder_create() {
 	nbt_coder_t* coder = malloc(sizeof(*coder));
@@ -51,6 +194,10 @@ nbt_coder_t* nbt_coder_create() {
 	coder->size = 0;
 	coder->cursor = 0;
 	coder->reserved = NBT_CODER_DEFAULT_CHUNK;
+	coder->storage = NBT_CODER_OWNED;
+	coder->stream = NULL;
+	coder->sink = NULL;
+	coder->failed = false;
 	return coder;
 }
 
@@ -76,14 +223,297 @@ nbt_coder_t* nbt_coder_create_data(const char* data, size_t size) {
 	return coder;
 }
 
+nbt_coder_t* nbt_coder_create_mapped(const char* path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		close(fd);
+		return NULL;
+	}
+	char* data = NULL;
+	if (info.st_size > 0) {
+		data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return NULL;
+		}
+		/* The parser reads front to back exactly once */
+		madvise(data, info.st_size, MADV_SEQUENTIAL);
+	}
+	/* The mapping keeps the file alive on its own */
+	close(fd);
+	
+	nbt_coder_t* coder = malloc(sizeof(*coder));
+	coder->data = data;
+	coder->size = info.st_size;
+	coder->cursor = 0;
+	coder->reserved = info.st_size;
+	coder->storage = NBT_CODER_MAPPED;
+	coder->stream = NULL;
+	coder->sink = NULL;
+	coder->failed = false;
+	return coder;
+}
+
+nbt_coder_t* nbt_coder_create_borrowed(const char* data, size_t size) {
+	nbt_coder_t* coder = malloc(sizeof(*coder));
+	coder->data = (char*)data;
+	coder->size = size;
+	coder->cursor = 0;
+	coder->reserved = size;
+	coder->storage = NBT_CODER_BORROWED;
+	coder->stream = NULL;
+	coder->sink = NULL;
+	coder->failed = false;
+	return coder;
+}
+
+nbt_coder_t* nbt_coder_create_fd(int fd) {
+	nbt_coder_stream_t* stream = malloc(sizeof(*stream));
+	stream->read = _nbt_coder_fd_read;
+	stream->close = NULL;
+	stream->source.fd = fd;
+	return _nbt_coder_create_stream(stream);
+}
+
+nbt_coder_t* nbt_coder_create_stream(FILE* fp) {
+	nbt_coder_stream_t* stream = malloc(sizeof(*stream));
+	stream->read = _nbt_coder_fp_read;
+	stream->close = NULL;
+	stream->source.fp = fp;
+	return _nbt_coder_create_stream(stream);
+}
+
+nbt_coder_t* nbt_coder_create_inflate(nbt_coder_t* source) {
+	nbt_coder_stream_t* stream = malloc(sizeof(*stream));
+	memset(stream, 0, sizeof(*stream));
+	stream->read = _nbt_coder_inflate_read;
+	stream->close = _nbt_coder_inflate_close;
+	stream->source.inflate.source = source;
+	stream->source.inflate.status = Z_OK;
+	
+	/* automatic header detection */
+	int zlib_ret = inflateInit2(&stream->source.inflate.z, 15 + 32);
+	assert(zlib_ret == Z_OK);
+	(void)zlib_ret;
+	return _nbt_coder_create_stream(stream);
+}
+
+nbt_coder_t* _nbt_coder_create_stream(nbt_coder_stream_t* stream) {
+	nbt_coder_t* coder = malloc(sizeof(*coder));
+	coder->data = malloc(NBT_CODER_STREAM_WINDOW);
+	coder->size = 0;
+	coder->cursor = 0;
+	coder->reserved = NBT_CODER_STREAM_WINDOW;
+	coder->storage = NBT_CODER_STREAM;
+	coder->stream = stream;
+	coder->sink = NULL;
+	coder->failed = false;
+	return coder;
+}
+
+nbt_coder_t* nbt_coder_create_fd_sink(int fd) {
+	nbt_coder_sink_t* sink = malloc(sizeof(*sink));
+	memset(sink, 0, sizeof(*sink));
+	sink->write = _nbt_coder_fd_write;
+	sink->finish = _nbt_coder_fd_wait;
+	sink->close = _nbt_coder_fd_close;
+	sink->hand_off = _nbt_coder_fd_hand_off;
+	sink->finished = false;
+	sink->destination.fd.fd = fd;
+	pthread_mutex_init(&sink->destination.fd.lock, NULL);
+	pthread_cond_init(&sink->destination.fd.cond, NULL);
+	return _nbt_coder_create_sink(sink);
+}
+
+nbt_coder_t* nbt_coder_create_deflate(nbt_coder_t* destination, nbt_compression_strategy_t compression_strategy) {
+	nbt_coder_sink_t* sink = malloc(sizeof(*sink));
+	memset(sink, 0, sizeof(*sink));
+	sink->write = _nbt_coder_deflate_write;
+	sink->finish = _nbt_coder_deflate_finish;
+	sink->close = _nbt_coder_deflate_close;
+	sink->finished = false;
+	sink->destination.deflate.destination = destination;
+	
+	/* Same settings as nbt_coder_compress, so the output is identical */
+	int window_bits = 15;
+	if (compression_strategy == NBT_COMPRESSION_GZIP) {
+		window_bits += 16;
+	}
+	int zlib_ret = deflateInit2(&sink->destination.deflate.z,
+								Z_DEFAULT_COMPRESSION,
+								Z_DEFLATED,
+								window_bits,
+								8,
+								Z_DEFAULT_STRATEGY);
+	assert(zlib_ret == Z_OK);
+	(void)zlib_ret;
+	return _nbt_coder_create_sink(sink);
+}
+
+nbt_coder_t* _nbt_coder_create_sink(nbt_coder_sink_t* sink) {
+	nbt_coder_t* coder = malloc(sizeof(*coder));
+	coder->data = malloc(NBT_CODER_SINK_BUFFER);
+	coder->size = 0;
+	coder->cursor = 0;
+	coder->reserved = NBT_CODER_SINK_BUFFER;
+	coder->storage = NBT_CODER_SINK;
+	coder->stream = NULL;
+	coder->sink = sink;
+	coder->failed = false;
+	return coder;
+}
+
 void nbt_coder_release(nbt_coder_t* coder) {
 	if (coder) {
-		free(coder->data);
+		switch (coder->storage) {
+			case NBT_CODER_OWNED:
+				free(coder->data);
+				break;
+			case NBT_CODER_MAPPED:
+				if (coder->data) {
+					munmap(coder->data, coder->size);
+				}
+				break;
+			case NBT_CODER_BORROWED:
+				break;
+			case NBT_CODER_STREAM:
+				if (coder->stream->close) {
+					coder->stream->close(coder->stream);
+				}
+				free(coder->stream);
+				free(coder->data);
+				break;
+			case NBT_CODER_SINK:
+				nbt_coder_finish(coder);
+				if (coder->sink->close) {
+					coder->sink->close(coder->sink);
+				}
+				free(coder->sink);
+				free(coder->data);
+				break;
+		}
 		free(coder);
 	}
 }
 
+const char* nbt_coder_data(nbt_coder_t* coder) {
+	return coder->data;
+}
+
+size_t nbt_coder_size(nbt_coder_t* coder) {
+	return coder->size;
+}
+
+void nbt_coder_reset(nbt_coder_t* coder) {
+	assert(coder->storage == NBT_CODER_OWNED);
+	coder->size = 0;
+	coder->cursor = 0;
+}
+
+void _nbt_coder_view(nbt_coder_t* coder, const char* data, size_t size) {
+	assert(coder->storage == NBT_CODER_BORROWED);
+	coder->data = (char*)data;
+	coder->size = size;
+	coder->cursor = 0;
+	coder->reserved = size;
+}
+
+bool _nbt_coder_whole(nbt_coder_t* coder) {
+	return coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK;
+}
+
+size_t _nbt_coder_tell(nbt_coder_t* coder) {
+	return coder->cursor;
+}
+
+void _nbt_coder_seek(nbt_coder_t* coder, size_t offset) {
+	assert(coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK);
+	assert(offset <= coder->size);
+	coder->cursor = offset;
+}
+
+void _nbt_coder_skip(nbt_coder_t* coder, size_t length) {
+	bool skipped = _nbt_coder_skip_checked(coder, length);
+	/* Truncated input */
+	assert(skipped);
+	(void)skipped;
+}
+
+bool _nbt_coder_skip_checked(nbt_coder_t* coder, size_t length) {
+	/* Like nbt_coder_decode_data, a stream's window might not hold all of it */
+	while (coder->storage == NBT_CODER_STREAM && coder->cursor + length > coder->size) {
+		length -= coder->size - coder->cursor;
+		coder->cursor = coder->size;
+		_nbt_coder_refill(coder, length < coder->reserved ? length : coder->reserved);
+		if (!coder->size) {
+			return false;
+		}
+	}
+	if (coder->cursor + length > coder->size) {
+		return false;
+	}
+	coder->cursor += length;
+	return true;
+}
+
+bool _nbt_coder_ensure(nbt_coder_t* coder, size_t length) {
+	if (coder->cursor + length > coder->size) {
+		_nbt_coder_refill(coder, length);
+	}
+	return coder->cursor + length <= coder->size;
+}
+
+nbt_coder_t* _nbt_coder_drain(nbt_coder_t* coder) {
+	nbt_coder_t* drained = nbt_coder_create();
+	_nbt_coder_drain_into(coder, drained, 0);
+	return drained;
+}
+
+bool _nbt_coder_drain_into(nbt_coder_t* coder, nbt_coder_t* drained, size_t limit) {
+	size_t start = drained->size;
+	for (;;) {
+		size_t length = coder->size - coder->cursor;
+		if (limit && drained->size - start + length > limit) {
+			return false;
+		}
+		nbt_coder_append_data(drained, coder->data + coder->cursor, length);
+		coder->cursor = coder->size;
+		if (coder->storage != NBT_CODER_STREAM) {
+			break;
+		}
+		_nbt_coder_refill(coder, 1);
+		if (!coder->size) {
+			break;
+		}
+	}
+	drained->cursor = 0;
+	return true;
+}
+
+bool nbt_coder_flush(nbt_coder_t* coder) {
+	if (coder->sink && !coder->sink->finished) {
+		_nbt_coder_flush(coder, NULL, 0);
+	}
+	return !coder->failed;
+}
+
+bool nbt_coder_finish(nbt_coder_t* coder) {
+	if (coder->sink && !coder->sink->finished) {
+		_nbt_coder_flush(coder, NULL, 0);
+		if (!coder->failed && coder->sink->finish) {
+			coder->failed = !coder->sink->finish(coder->sink);
+		}
+		coder->sink->finished = true;
+	}
+	return !coder->failed;
+}
+
 void nbt_coder_write_file(nbt_coder_t* coder, const char* path) {
+	assert(coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK);
 	FILE* fp = fopen(path, "w");
 	assert(fp);
 	fwrite(coder->data, coder->size, 1, fp);
@@ -174,9 +604,274 @@ void nbt_coder_encode_data(nbt_coder_t* coder, const char* data, size_t length)
 	coder->cursor += length;
 }
 
+void nbt_coder_reserve(nbt_coder_t* coder, size_t length) {
+	/* A sink can't hold more than its buffer, big runs get chunked as they're appended */
+	if (coder->reserved - coder->size < length && (!coder->sink || length <= coder->reserved)) {
+		_nbt_coder_make_room(coder, length);
+	}
+}
+
+void nbt_coder_append_byte(nbt_coder_t* coder, int8_t item) {
+	*_nbt_coder_append(coder, sizeof(item)) = item;
+}
+
+void nbt_coder_append_short(nbt_coder_t* coder, int16_t item, nbt_byte_order_t order) {
+	item = nbt_reorder_short(item, order);
+	memcpy(_nbt_coder_append(coder, sizeof(item)), &item, sizeof(item));
+}
+
+void nbt_coder_append_int(nbt_coder_t* coder, int32_t item, nbt_byte_order_t order) {
+	item = nbt_reorder_int(item, order);
+	memcpy(_nbt_coder_append(coder, sizeof(item)), &item, sizeof(item));
+}
+
+void nbt_coder_append_long(nbt_coder_t* coder, int64_t item, nbt_byte_order_t order) {
+	item = nbt_reorder_long(item, order);
+	memcpy(_nbt_coder_append(coder, sizeof(item)), &item, sizeof(item));
+}
+
+void nbt_coder_append_float(nbt_coder_t* coder, float item, nbt_byte_order_t order) {
+	item = nbt_reorder_float(item, order);
+	memcpy(_nbt_coder_append(coder, sizeof(item)), &item, sizeof(item));
+}
+
+void nbt_coder_append_double(nbt_coder_t* coder, double item, nbt_byte_order_t order) {
+	item = nbt_reorder_double(item, order);
+	memcpy(_nbt_coder_append(coder, sizeof(item)), &item, sizeof(item));
+}
+
+void nbt_coder_append_data(nbt_coder_t* coder, const char* data, size_t length) {
+	if (coder->sink && coder->reserved - coder->size < length) {
+		/* Send it along with the buffer instead of copying it through */
+		_nbt_coder_flush(coder, data, length);
+		return;
+	}
+	memcpy(_nbt_coder_append(coder, length), data, length);
+}
+
+void nbt_coder_append_shorts(nbt_coder_t* coder, const int16_t* items, size_t count, nbt_byte_order_t order) {
+	_nbt_coder_append_array(coder, items, count, sizeof(*items), order, nbt_reorder_shorts);
+}
+
+void nbt_coder_append_ints(nbt_coder_t* coder, const int32_t* items, size_t count, nbt_byte_order_t order) {
+	_nbt_coder_append_array(coder, items, count, sizeof(*items), order, nbt_reorder_ints);
+}
+
+void nbt_coder_append_longs(nbt_coder_t* coder, const int64_t* items, size_t count, nbt_byte_order_t order) {
+	_nbt_coder_append_array(coder, items, count, sizeof(*items), order, nbt_reorder_longs);
+}
+
+void _nbt_coder_append_array(nbt_coder_t* coder, const void* items, size_t count, size_t width, nbt_byte_order_t order, void (*reorder)(void*, const void*, size_t, nbt_byte_order_t)) {
+	if (!coder->sink) {
+		reorder(_nbt_coder_append(coder, count * width), items, count, order);
+		return;
+	}
+	/* Convert into the sink's buffer a bufferful at a time */
+	const char* next = items;
+	while (count) {
+		size_t room = (coder->reserved - coder->size) / width;
+		if (!room) {
+			_nbt_coder_make_room(coder, width);
+			continue;
+		}
+		size_t chunk = count < room ? count : room;
+		reorder(_nbt_coder_append(coder, chunk * width), next, chunk, order);
+		next += chunk * width;
+		count -= chunk;
+	}
+}
+
+void _nbt_coder_make_room(nbt_coder_t* coder, size_t length) {
+	if (coder->sink && coder->sink->hand_off) {
+		/* Carry on into another buffer while this one's written */
+		assert(!coder->sink->finished);
+		if (!coder->failed && coder->size) {
+			coder->failed = !coder->sink->hand_off(coder->sink, &coder->data, coder->size);
+		}
+		coder->size = 0;
+		coder->cursor = 0;
+		assert(length <= coder->reserved);
+	} else if (coder->sink) {
+		_nbt_coder_flush(coder, NULL, 0);
+		assert(length <= coder->reserved);
+	} else {
+		_nbt_coder_reserve(coder, coder->size + length);
+	}
+}
+
+void _nbt_coder_flush(nbt_coder_t* coder, const char* extra, size_t extra_length) {
+	assert(!coder->sink->finished);
+	/* After a failed write everything else is dropped, nbt_coder_flush reports it */
+	if (!coder->failed && (coder->size || extra_length)) {
+		coder->failed = !coder->sink->write(coder->sink, coder->data, coder->size, extra, extra_length);
+	}
+	coder->size = 0;
+	coder->cursor = 0;
+}
+
+/* Explicit flushes and pass-through data go out straight away, after anything handed off */
+bool _nbt_coder_fd_write(nbt_coder_sink_t* sink, const char* data, size_t length, const char* extra, size_t extra_length) {
+	return _nbt_coder_fd_wait(sink) && _nbt_coder_fd_writev(sink->destination.fd.fd, data, length, extra, extra_length);
+}
+
+bool _nbt_coder_fd_hand_off(nbt_coder_sink_t* sink, char** buffer, size_t length) {
+	nbt_coder_fd_sink_t* fd = &sink->destination.fd;
+	pthread_mutex_lock(&fd->lock);
+	if (!fd->started) {
+		/* Only sinks that fill a buffer get a thread */
+		fd->started = !pthread_create(&fd->thread, NULL, _nbt_coder_fd_writer, sink);
+	}
+	while (fd->writing) {
+		pthread_cond_wait(&fd->cond, &fd->lock);
+	}
+	bool ok = !fd->failed;
+	if (ok && !fd->started) {
+		/* No thread to be had, write it here instead */
+		pthread_mutex_unlock(&fd->lock);
+		return _nbt_coder_fd_writev(fd->fd, *buffer, length, NULL, 0);
+	}
+	if (ok) {
+		char* spare = fd->spare ? fd->spare : malloc(NBT_CODER_SINK_BUFFER);
+		fd->spare = NULL;
+		fd->writing = *buffer;
+		fd->writing_length = length;
+		*buffer = spare;
+		pthread_cond_broadcast(&fd->cond);
+	}
+	pthread_mutex_unlock(&fd->lock);
+	return ok;
+}
+
+/* Until anything handed off has been written, false if it couldn't be */
+bool _nbt_coder_fd_wait(nbt_coder_sink_t* sink) {
+	nbt_coder_fd_sink_t* fd = &sink->destination.fd;
+	pthread_mutex_lock(&fd->lock);
+	while (fd->writing) {
+		pthread_cond_wait(&fd->cond, &fd->lock);
+	}
+	bool ok = !fd->failed;
+	pthread_mutex_unlock(&fd->lock);
+	return ok;
+}
+
+void _nbt_coder_fd_close(nbt_coder_sink_t* sink) {
+	nbt_coder_fd_sink_t* fd = &sink->destination.fd;
+	if (fd->started) {
+		pthread_mutex_lock(&fd->lock);
+		fd->stop = true;
+		pthread_cond_broadcast(&fd->cond);
+		pthread_mutex_unlock(&fd->lock);
+		pthread_join(fd->thread, NULL);
+	}
+	free(fd->spare);
+	pthread_cond_destroy(&fd->cond);
+	pthread_mutex_destroy(&fd->lock);
+}
+
+void* _nbt_coder_fd_writer(void* argument) {
+	nbt_coder_sink_t* sink = argument;
+	nbt_coder_fd_sink_t* fd = &sink->destination.fd;
+	pthread_mutex_lock(&fd->lock);
+	for (;;) {
+		while (!fd->writing && !fd->stop) {
+			pthread_cond_wait(&fd->cond, &fd->lock);
+		}
+		if (!fd->writing) {
+			break;
+		}
+		char* buffer = fd->writing;
+		size_t length = fd->writing_length;
+		bool failed = fd->failed;
+		pthread_mutex_unlock(&fd->lock);
+		/* After a failure the rest is dropped, the coder finds out on its next hand off or flush */
+		bool ok = failed || _nbt_coder_fd_writev(fd->fd, buffer, length, NULL, 0);
+		pthread_mutex_lock(&fd->lock);
+		fd->failed |= !ok;
+		fd->writing = NULL;
+		fd->spare = buffer;
+		pthread_cond_broadcast(&fd->cond);
+	}
+	pthread_mutex_unlock(&fd->lock);
+	return NULL;
+}
+
+bool _nbt_coder_fd_writev(int fd, const char* data, size_t length, const char* extra, size_t extra_length) {
+	struct iovec vectors[2] = {
+		{ .iov_base = (void*)data, .iov_len = length },
+		{ .iov_base = (void*)extra, .iov_len = extra_length }
+	};
+	struct iovec* next = vectors;
+	int count = 2;
+	while (count) {
+		ssize_t written = writev(fd, next, count);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		/* Skip past whatever made it out, possibly partway into a vector */
+		while (count && (size_t)written >= next->iov_len) {
+			written -= next->iov_len;
+			next++;
+			count--;
+		}
+		if (count) {
+			next->iov_base = (char*)next->iov_base + written;
+			next->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+bool _nbt_coder_deflate_write(nbt_coder_sink_t* sink, const char* data, size_t length, const char* extra, size_t extra_length) {
+	return _nbt_coder_deflate(sink, data, length, Z_NO_FLUSH) && _nbt_coder_deflate(sink, extra, extra_length, Z_NO_FLUSH);
+}
+
+bool _nbt_coder_deflate_finish(nbt_coder_sink_t* sink) {
+	return _nbt_coder_deflate(sink, NULL, 0, Z_FINISH) && nbt_coder_flush(sink->destination.deflate.destination);
+}
+
+void _nbt_coder_deflate_close(nbt_coder_sink_t* sink) {
+	deflateEnd(&sink->destination.deflate.z);
+}
+
+/* Compress straight into the end of the destination, which flushes itself if it's a sink too */
+bool _nbt_coder_deflate(nbt_coder_sink_t* sink, const char* data, size_t length, int flush) {
+	z_stream* z = &sink->destination.deflate.z;
+	nbt_coder_t* destination = sink->destination.deflate.destination;
+	if (!length && flush == Z_NO_FLUSH) {
+		return !destination->failed;
+	}
+	
+	do {
+		uInt avail_in = (uInt)(length < UINT32_MAX ? length : UINT32_MAX);
+		int mode = avail_in == length ? flush : Z_NO_FLUSH;
+		z->next_in = (Bytef*)data;
+		z->avail_in = avail_in;
+		int zlib_ret;
+		do {
+			if (destination->reserved - destination->size < NBT_CODER_DEFLATE_SPACE) {
+				_nbt_coder_make_room(destination, NBT_CODER_DEFLATE_SPACE);
+			}
+			size_t room = destination->reserved - destination->size;
+			z->next_out = (Bytef*)destination->data + destination->size;
+			z->avail_out = (uInt)(room < UINT32_MAX ? room : UINT32_MAX);
+			uInt avail_out = z->avail_out;
+			zlib_ret = deflate(z, mode);
+			assert(zlib_ret != Z_STREAM_ERROR);
+			destination->size += avail_out - z->avail_out;
+			destination->cursor = destination->size;
+		} while (z->avail_out == 0 || (mode == Z_FINISH && zlib_ret != Z_STREAM_END));
+		data += avail_in;
+		length -= avail_in;
+	} while (length);
+	return !destination->failed;
+}
+
 int8_t nbt_coder_decode_byte(nbt_coder_t* coder) {
 	int8_t item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return item;
@@ -184,7 +879,7 @@ int8_t nbt_coder_decode_byte(nbt_coder_t* coder) {
 
 int16_t nbt_coder_decode_short(nbt_coder_t* coder, nbt_byte_order_t order) {
 	int16_t item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return nbt_reorder_short(item, order);
@@ -192,7 +887,7 @@ int16_t nbt_coder_decode_short(nbt_coder_t* coder, nbt_byte_order_t order) {
 
 int32_t nbt_coder_decode_int(nbt_coder_t* coder, nbt_byte_order_t order) {
 	int32_t item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return nbt_reorder_int(item, order);
@@ -200,7 +895,7 @@ int32_t nbt_coder_decode_int(nbt_coder_t* coder, nbt_byte_order_t order) {
 
 int64_t nbt_coder_decode_long(nbt_coder_t* coder, nbt_byte_order_t order) {
 	int64_t item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return nbt_reorder_long(item, order);
@@ -208,7 +903,7 @@ int64_t nbt_coder_decode_long(nbt_coder_t* coder, nbt_byte_order_t order) {
 
 float nbt_coder_decode_float(nbt_coder_t* coder, nbt_byte_order_t order) {
 	float item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return nbt_reorder_float(item, order);
@@ -216,40 +911,156 @@ float nbt_coder_decode_float(nbt_coder_t* coder, nbt_byte_order_t order) {
 
 double nbt_coder_decode_double(nbt_coder_t* coder, nbt_byte_order_t order) {
 	double item;
-	assert(coder->cursor + sizeof(__typeof__(item)) <= coder->size);
+	_nbt_coder_require(coder, sizeof(item));
 	item = *(__typeof__(item)*)((uintptr_t)coder->data + coder->cursor);
 	coder->cursor += sizeof(item);
 	return nbt_reorder_double(item, order);
 }
 
 void nbt_coder_decode_data(nbt_coder_t* coder, char* buffer, size_t length) {
-	assert(coder->cursor + length <= coder->size);
+	/* Payloads can be bigger than a stream's window, so drain it piecewise */
+	while (coder->storage == NBT_CODER_STREAM && coder->cursor + length > coder->size) {
+		size_t available = coder->size - coder->cursor;
+		memcpy(buffer, (void*)((uintptr_t)coder->data + coder->cursor), available);
+		buffer += available;
+		length -= available;
+		coder->cursor = coder->size;
+		_nbt_coder_refill(coder, length < coder->reserved ? length : coder->reserved);
+		/* Truncated input */
+		assert(coder->size);
+	}
+	_nbt_coder_require(coder, length);
 	memcpy(buffer, (void*)((uintptr_t)coder->data + coder->cursor), length);
 	coder->cursor += length;
 }
 
+void nbt_coder_decode_shorts(nbt_coder_t* coder, int16_t* buffer, size_t count, nbt_byte_order_t order) {
+	nbt_coder_decode_data(coder, (char*)buffer, count * sizeof(*buffer));
+	nbt_reorder_shorts(buffer, buffer, count, order);
+}
+
+void nbt_coder_decode_ints(nbt_coder_t* coder, int32_t* buffer, size_t count, nbt_byte_order_t order) {
+	nbt_coder_decode_data(coder, (char*)buffer, count * sizeof(*buffer));
+	nbt_reorder_ints(buffer, buffer, count, order);
+}
+
+void nbt_coder_decode_longs(nbt_coder_t* coder, int64_t* buffer, size_t count, nbt_byte_order_t order) {
+	nbt_coder_decode_data(coder, (char*)buffer, count * sizeof(*buffer));
+	nbt_reorder_longs(buffer, buffer, count, order);
+}
+
 void _nbt_coder_reserve(nbt_coder_t* coder, size_t reserved) {
+	bool reserved_ok = _nbt_coder_try_reserve(coder, reserved);
+	assert(reserved_ok);
+	(void)reserved_ok;
+}
+
+/* Grows geometrically, and leaves the coder as it was if it can't */
+bool _nbt_coder_try_reserve(nbt_coder_t* coder, size_t reserved) {
+	/* Mapped and borrowed coders can only be decoded from */
+	assert(coder->storage == NBT_CODER_OWNED);
 	if (!coder->data) {
 		coder->data = malloc(NBT_CODER_DEFAULT_CHUNK);
+		if (!coder->data) {
+			return false;
+		}
 		coder->reserved = NBT_CODER_DEFAULT_CHUNK;
 	}
 	if (coder->reserved < reserved) {
+		size_t grown = coder->reserved;
 		do {
-			coder->reserved <<= 1;
-		} while (coder->reserved < reserved);
-		coder->data = realloc(coder->data, coder->reserved);
+			if (grown > SIZE_MAX / 2) {
+				return false;
+			}
+			grown <<= 1;
+		} while (grown < reserved);
+		char* data = realloc(coder->data, grown);
+		if (!data) {
+			return false;
+		}
+		coder->data = data;
+		coder->reserved = grown;
+	}
+	return true;
+}
+
+void _nbt_coder_refill(nbt_coder_t* coder, size_t length) {
+	if (coder->storage != NBT_CODER_STREAM) {
+		return;
+	}
+	assert(length <= coder->reserved);
+	
+	/* Slide whatever hasn't been decoded yet to the front of the window */
+	size_t remaining = coder->size - coder->cursor;
+	memmove(coder->data, (void*)((uintptr_t)coder->data + coder->cursor), remaining);
+	coder->size = remaining;
+	coder->cursor = 0;
+	
+	while (coder->size < length) {
+		size_t count = coder->stream->read(coder->stream, coder->data + coder->size, coder->reserved - coder->size);
+		if (!count) {
+			break;
+		}
+		coder->size += count;
 	}
 }
 
+size_t _nbt_coder_fd_read(nbt_coder_stream_t* stream, char* buffer, size_t length) {
+	ssize_t count;
+	do {
+		count = read(stream->source.fd, buffer, length);
+	} while (count < 0 && errno == EINTR);
+	return count > 0 ? count : 0;
+}
+
+size_t _nbt_coder_fp_read(nbt_coder_stream_t* stream, char* buffer, size_t length) {
+	return fread(buffer, 1, length, stream->source.fp);
+}
+
+size_t _nbt_coder_inflate_read(nbt_coder_stream_t* stream, char* buffer, size_t length) {
+	z_stream* z = &stream->source.inflate.z;
+	nbt_coder_t* source = stream->source.inflate.source;
+	
+	z->next_out = (Bytef*)buffer;
+	z->avail_out = (uInt)(length < UINT32_MAX ? length : UINT32_MAX);
+	uInt avail_out = z->avail_out;
+	while (z->avail_out && stream->source.inflate.status != Z_STREAM_END) {
+		if (source->cursor == source->size) {
+			_nbt_coder_refill(source, 1);
+			if (source->cursor == source->size) {
+				/* Truncated input */
+				break;
+			}
+		}
+		size_t available = source->size - source->cursor;
+		z->next_in = (Bytef*)source->data + source->cursor;
+		z->avail_in = (uInt)(available < UINT32_MAX ? available : UINT32_MAX);
+		uInt avail_in = z->avail_in;
+		switch ((stream->source.inflate.status = inflate(z, Z_NO_FLUSH))) {
+			case Z_MEM_ERROR:
+			case Z_DATA_ERROR:
+			case Z_NEED_DICT:
+			case Z_STREAM_ERROR:
+				assert(0);
+			default:
+				source->cursor += avail_in - z->avail_in;
+		}
+	}
+	return avail_out - z->avail_out;
+}
+
+void _nbt_coder_inflate_close(nbt_coder_stream_t* stream) {
+	inflateEnd(&stream->source.inflate.z);
+}
+
 nbt_coder_t* nbt_coder_compress(nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy) {
+	assert(coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK);
 	nbt_coder_t* ret_coder = nbt_coder_create();
 	
 	z_stream stream = {
 		.zalloc		= Z_NULL,
 		.zfree		= Z_NULL,
-		.opaque		= Z_NULL,
-		.next_in	= (void*)coder->data,
-		.avail_in	= (uInt)coder->size
+		.opaque		= Z_NULL
 	};
 	
 	/* Should be from 8..15 */
@@ -261,59 +1072,276 @@ nbt_coder_t* nbt_coder_compress(nbt_coder_t* coder, nbt_compression_strategy_t c
 	}
 	
 	/* Start the compression */
-	assert(!deflateInit2(&stream,
-						 Z_DEFAULT_COMPRESSION,
-						 Z_DEFLATED,
-						 window_bits,
-						 8,
-						 Z_DEFAULT_STRATEGY));
+	int zlib_ret = deflateInit2(&stream,
+								Z_DEFAULT_COMPRESSION,
+								Z_DEFLATED,
+								window_bits,
+								8,
+								Z_DEFAULT_STRATEGY);
+	assert(zlib_ret == Z_OK);
+	(void)zlib_ret;
 	
+	_nbt_coder_deflate_all(&stream, coder, ret_coder);
+	
+	deflateEnd(&stream);
+	return ret_coder;
+}
+
+void _nbt_coder_deflate_all(z_stream* stream, nbt_coder_t* coder, nbt_coder_t* ret_coder) {
+	/* Room for the worst case up front, so it's normally a single deflate call */
+	_nbt_coder_reserve(ret_coder, ret_coder->size + deflateBound(stream, coder->size));
+	
+	size_t consumed = 0;
+	int zlib_ret;
 	do {
-		_nbt_coder_reserve(ret_coder, ret_coder->size + NBT_CODER_DEFAULT_CHUNK);
+		if (ret_coder->size == ret_coder->reserved) {
+			_nbt_coder_reserve(ret_coder, ret_coder->reserved + 1);
+		}
 		
-		stream.next_out = (Bytef*)ret_coder->data + ret_coder->size;
-		stream.avail_out = NBT_CODER_DEFAULT_CHUNK;
+		size_t available_in = coder->size - consumed;
+		size_t available_out = ret_coder->reserved - ret_coder->size;
+		stream->next_in = (Bytef*)coder->data + consumed;
+		stream->avail_in = (uInt)(available_in < UINT32_MAX ? available_in : UINT32_MAX);
+		stream->next_out = (Bytef*)ret_coder->data + ret_coder->size;
+		stream->avail_out = (uInt)(available_out < UINT32_MAX ? available_out : UINT32_MAX);
+		uInt avail_in = stream->avail_in;
+		uInt avail_out = stream->avail_out;
 		
-		assert(deflate(&stream, Z_FINISH) != Z_STREAM_ERROR);
+		zlib_ret = deflate(stream, avail_in == available_in ? Z_FINISH : Z_NO_FLUSH);
+		assert(zlib_ret != Z_STREAM_ERROR);
 		
-		ret_coder->size += NBT_CODER_DEFAULT_CHUNK - stream.avail_out;
-	} while (stream.avail_out == 0);
+		consumed += avail_in - stream->avail_in;
+		ret_coder->size += avail_out - stream->avail_out;
+	} while (zlib_ret != Z_STREAM_END);
+}
+
+nbt_coder_t* nbt_coder_compress_parallel(nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy, size_t threads) {
+	assert(coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK);
+	size_t count = (coder->size + NBT_CODER_PARALLEL_BLOCK - 1) / NBT_CODER_PARALLEL_BLOCK;
+	if (count < 2 || threads == 1) {
+		return nbt_coder_compress(coder, compression_strategy);
+	}
 	
-	deflateEnd(&stream);
+	nbt_coder_blocks_t work = {
+		.blocks					= malloc(sizeof(*work.blocks) * count),
+		.count					= count,
+		.compression_strategy	= compression_strategy
+	};
+	for (size_t i = 0; i < count; i++) {
+		work.blocks[i].input = (const Bytef*)coder->data + i * NBT_CODER_PARALLEL_BLOCK;
+		work.blocks[i].length = i + 1 < count ? NBT_CODER_PARALLEL_BLOCK : coder->size - i * NBT_CODER_PARALLEL_BLOCK;
+	}
+	_nbt_parallel_for(count, threads, _nbt_coder_compress_block, &work);
+	
+	/* Stitch the blocks together between a header and a trailer written by hand */
+	nbt_coder_t* ret_coder = nbt_coder_create();
+	uLong check = work.blocks[0].check;
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++) {
+		total += work.blocks[i].size;
+		if (i) {
+			check = compression_strategy == NBT_COMPRESSION_GZIP
+				? crc32_combine(check, work.blocks[i].check, (z_off_t)work.blocks[i].length)
+				: adler32_combine(check, work.blocks[i].check, (z_off_t)work.blocks[i].length);
+		}
+	}
+	nbt_coder_reserve(ret_coder, total + 18);
+	if (compression_strategy == NBT_COMPRESSION_GZIP) {
+		/* No name or mtime, unix */
+		static const char header[] = { 0x1f, (char)0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+		nbt_coder_append_data(ret_coder, header, sizeof(header));
+	} else {
+		/* 32K window, default level */
+		nbt_coder_append_short(ret_coder, 0x789c, NBT_BIG_ENDIAN);
+	}
+	for (size_t i = 0; i < count; i++) {
+		nbt_coder_append_data(ret_coder, (const char*)work.blocks[i].output, work.blocks[i].size);
+		free(work.blocks[i].output);
+	}
+	if (compression_strategy == NBT_COMPRESSION_GZIP) {
+		nbt_coder_append_int(ret_coder, (int32_t)check, NBT_LITTLE_ENDIAN);
+		nbt_coder_append_int(ret_coder, (int32_t)coder->size, NBT_LITTLE_ENDIAN);
+	} else {
+		nbt_coder_append_int(ret_coder, (int32_t)check, NBT_BIG_ENDIAN);
+	}
+	free(work.blocks);
+	
+	/* Ready to be decoded, like nbt_coder_compress leaves it */
+	ret_coder->cursor = 0;
 	return ret_coder;
 }
 
+void _nbt_coder_compress_block(void* context, size_t index) {
+	nbt_coder_blocks_t* work = context;
+	nbt_coder_block_t* block = &work->blocks[index];
+	bool last = index + 1 == work->count;
+	
+	z_stream stream = {
+		.zalloc		= Z_NULL,
+		.zfree		= Z_NULL,
+		.opaque		= Z_NULL,
+		.next_in	= (Bytef*)block->input,
+		.avail_in	= (uInt)block->length
+	};
+	
+	/* Raw deflate, the header and trailer go around all the blocks */
+	int zlib_ret = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	assert(zlib_ret == Z_OK);
+	
+	/* Prime with the end of the previous block so matches can reach back across the seam */
+	if (index) {
+		size_t dictionary = block->input - work->blocks[0].input;
+		if (dictionary > NBT_CODER_DICTIONARY) {
+			dictionary = NBT_CODER_DICTIONARY;
+		}
+		zlib_ret = deflateSetDictionary(&stream, block->input - dictionary, (uInt)dictionary);
+		assert(zlib_ret == Z_OK);
+	}
+	
+	/* Room for a sync flush's empty stored block on top of the bound */
+	size_t reserved = deflateBound(&stream, block->length) + 16;
+	block->output = malloc(reserved);
+	stream.next_out = block->output;
+	stream.avail_out = (uInt)reserved;
+	
+	/* Every block but the last ends byte aligned and unfinished so the next one can follow it */
+	zlib_ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+	assert(last ? zlib_ret == Z_STREAM_END : zlib_ret == Z_OK && stream.avail_in == 0);
+	(void)zlib_ret;
+	block->size = reserved - stream.avail_out;
+	deflateEnd(&stream);
+	
+	block->check = work->compression_strategy == NBT_COMPRESSION_GZIP
+		? crc32(crc32(0, Z_NULL, 0), block->input, (uInt)block->length)
+		: adler32(adler32(0, Z_NULL, 0), block->input, (uInt)block->length);
+}
+
 nbt_coder_t* nbt_coder_decompress(nbt_coder_t* coder) {
+	return nbt_coder_decompress_hint(coder, 0);
+}
+
+nbt_coder_t* nbt_coder_decompress_hint(nbt_coder_t* coder, size_t expected_size) {
+	nbt_coder_t* ret_coder = _nbt_coder_decompress(coder, expected_size, 0, NULL);
+	assert(ret_coder);
+	return ret_coder;
+}
+
+nbt_coder_t* nbt_coder_decompress_limit(nbt_coder_t* coder, size_t limit, nbt_status_t* errorp) {
+	return _nbt_coder_decompress(coder, 0, limit, errorp);
+}
+
+nbt_coder_t* _nbt_coder_decompress(nbt_coder_t* coder, size_t expected_size, size_t limit, nbt_status_t* errorp) {
+	assert(coder->storage != NBT_CODER_STREAM && coder->storage != NBT_CODER_SINK);
 	nbt_coder_t* ret_coder = nbt_coder_create();
 	
 	z_stream stream = {
 		.zalloc		= Z_NULL,
 		.zfree		= Z_NULL,
 		.opaque		= Z_NULL,
-		.next_in	= (void*)coder->data,
-		.avail_in	= (uInt)coder->size
+		.next_in	= Z_NULL,
+		.avail_in	= 0
 	};
 	
 	/* automatic header detection */
-	assert(inflateInit2(&stream, 15 + 32) == Z_OK);
+	int zlib_ret = inflateInit2(&stream, 15 + 32);
+	assert(zlib_ret == Z_OK);
+	(void)zlib_ret;
+	
+	nbt_status_t status = _nbt_coder_inflate_all(&stream, coder, ret_coder, expected_size, limit);
 	
+	inflateEnd(&stream);
+	if (status) {
+		nbt_coder_release(ret_coder);
+		ret_coder = NULL;
+		if (errorp) {
+			*errorp = status;
+		}
+	}
+	return ret_coder;
+}
+
+nbt_status_t _nbt_coder_inflate_all(z_stream* stream, nbt_coder_t* coder, nbt_coder_t* ret_coder, size_t expected_size, size_t limit) {
+	assert(ret_coder->storage == NBT_CODER_OWNED);
+	if (!expected_size) {
+		expected_size = _nbt_coder_inflated_size(coder);
+	}
+	/* One byte over the limit is enough to know it's been passed */
+	size_t cap = limit ? ret_coder->size + limit + 1 : SIZE_MAX;
+	if (limit && expected_size > limit + 1) {
+		expected_size = limit + 1;
+	}
+	/* A gzip trailer is just a claim, past the ceiling the output has to earn its room */
+	if (expected_size > NBT_CODER_HINT_MAX) {
+		expected_size = NBT_CODER_HINT_MAX;
+	}
+	
+	/* Size the output exactly so a correct hint inflates in one call */
+	if (ret_coder->reserved < ret_coder->size + expected_size) {
+		char* data = realloc(ret_coder->data, ret_coder->size + expected_size);
+		if (!data) {
+			return NBT_ERROR_MEMORY;
+		}
+		ret_coder->data = data;
+		ret_coder->reserved = ret_coder->size + expected_size;
+	}
+	
+	size_t consumed = 0;
 	int zlib_ret;
 	do {
-		_nbt_coder_reserve(ret_coder, ret_coder->size + NBT_CODER_DEFAULT_CHUNK);
+		if (ret_coder->size == ret_coder->reserved) {
+			/* The hint was short, fall back to geometric growth */
+			if (!_nbt_coder_try_reserve(ret_coder, ret_coder->reserved + 1)) {
+				return NBT_ERROR_MEMORY;
+			}
+		}
 		
-		stream.avail_out = NBT_CODER_DEFAULT_CHUNK;
-		stream.next_out = (Bytef*)ret_coder->data + ret_coder->size;
-		switch ((zlib_ret = inflate(&stream, Z_NO_FLUSH))) {
+		size_t available_in = coder->size - consumed;
+		size_t available_out = (ret_coder->reserved < cap ? ret_coder->reserved : cap) - ret_coder->size;
+		stream->next_in = (Bytef*)coder->data + consumed;
+		stream->avail_in = (uInt)(available_in < UINT32_MAX ? available_in : UINT32_MAX);
+		stream->next_out = (Bytef*)ret_coder->data + ret_coder->size;
+		stream->avail_out = (uInt)(available_out < UINT32_MAX ? available_out : UINT32_MAX);
+		uInt avail_in = stream->avail_in;
+		uInt avail_out = stream->avail_out;
+		
+		switch ((zlib_ret = inflate(stream, Z_FINISH))) {
 			case Z_MEM_ERROR:
 			case Z_DATA_ERROR:
 			case Z_NEED_DICT:
-				assert(0);
+			case Z_STREAM_ERROR:
+				return NBT_ERROR_ZLIB;
 			default:
-				ret_coder->size += NBT_CODER_DEFAULT_CHUNK - stream.avail_out;
+				consumed += avail_in - stream->avail_in;
+				ret_coder->size += avail_out - stream->avail_out;
+		}
+		
+		if (ret_coder->size == cap) {
+			return NBT_ERROR_LIMIT;
 		}
-	} while (stream.avail_out == 0);
+		/* Out of input with room to spare means the stream was truncated */
+		if (zlib_ret != Z_STREAM_END && consumed == coder->size && ret_coder->size < ret_coder->reserved) {
+			return NBT_ERROR_ZLIB;
+		}
+	} while (zlib_ret != Z_STREAM_END);
+	return NBT_SUCCESS;
+}
+
+size_t _nbt_coder_inflated_size(nbt_coder_t* coder) {
+	const uint8_t* bytes = (const uint8_t*)coder->data;
+	size_t estimate = coder->size * 4;
 	
-	assert(zlib_ret == Z_STREAM_END);
-	inflateEnd(&stream);
-	return ret_coder;
+	/* gzip ends with the uncompressed size mod 2^32, little endian */
+	if (coder->size >= 18 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+		const uint8_t* isize = bytes + coder->size - 4;
+		estimate = (size_t)isize[0] | (size_t)isize[1] << 8 | (size_t)isize[2] << 16 | (size_t)isize[3] << 24;
+	}
+	
+	/* deflate tops out around 1032:1, so don't believe a trailer claiming more */
+	if (estimate > coder->size * 1032) {
+		estimate = coder->size * 1032;
+	}
+	if (estimate < NBT_CODER_DEFAULT_CHUNK) {
+		estimate = NBT_CODER_DEFAULT_CHUNK;
+	}
+	return estimate;
 }
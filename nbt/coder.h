@@ -30,6 +30,7 @@
 #ifndef coder_h
 #define coder_h
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "byte_order.h"
@@ -44,6 +45,56 @@ nbt_coder_t* nbt_coder_create_file(const char* path);
 nbt_coder_t* nbt_coder_create_data(const char* data, size_t size);
 void nbt_coder_release(nbt_coder_t* coder);
 
+/*
+ * Read only, zero-copy coders. Decoding reads straight out of the source and
+ * encoding into them is an error.
+ *
+ * A mapped coder owns its mmap of `path` and unmaps it on release; it returns
+ * NULL if the file can't be opened or mapped. A borrowed coder never copies or
+ * frees `data`: the caller keeps ownership and must leave the bytes alive and
+ * unmodified until the coder has been released.
+ */
+nbt_coder_t* nbt_coder_create_mapped(const char* path);
+nbt_coder_t* nbt_coder_create_borrowed(const char* data, size_t size);
+
+/*
+ * Streaming input coders. Only a small fixed window of input is kept in memory
+ * and it's refilled on demand as the coder is decoded, so they can only be
+ * read front to back. An inflate coder pulls compressed bytes from `source`
+ * (gzip or zlib, detected automatically) as the window drains. The fd, FILE
+ * or source coder is borrowed: it's never closed and must outlive the coder.
+ */
+nbt_coder_t* nbt_coder_create_fd(int fd);
+nbt_coder_t* nbt_coder_create_stream(FILE* fp);
+nbt_coder_t* nbt_coder_create_inflate(nbt_coder_t* source);
+
+/*
+ * Output coders. A sink holds a bounded buffer that's flushed to its
+ * destination whenever an append doesn't fit, so the output never has to be
+ * in memory all at once. They're append only. Large data appends skip the
+ * buffer and go out in the same writev as it. An fd sink hands each full
+ * buffer to a writer thread of its own and carries on into a second one, so
+ * serializing overlaps with the writes; flushing and finishing wait for them.
+ * The fd is borrowed and is never closed.
+ */
+nbt_coder_t* nbt_coder_create_fd_sink(int fd);
+
+/* Push out anything buffered, false if any write to the sink has failed */
+bool nbt_coder_flush(nbt_coder_t* coder);
+
+/*
+ * Flush and end the output, e.g. write a compressed stream's trailer. Nothing
+ * can be appended afterwards. Releasing a sink finishes it if this wasn't called.
+ */
+bool nbt_coder_finish(nbt_coder_t* coder);
+
+/* Empty an ordinary coder but keep its buffer, so it can be encoded into again without allocating */
+void nbt_coder_reset(nbt_coder_t* coder);
+
+/* Raw access to the encoded bytes */
+const char* nbt_coder_data(nbt_coder_t* coder);
+size_t nbt_coder_size(nbt_coder_t* coder);
+
 /* File System */
 void nbt_coder_write_file(nbt_coder_t* coder, const char* path);
 
@@ -56,6 +107,23 @@ void nbt_coder_encode_float(nbt_coder_t* coder, float item, nbt_byte_order_t ord
 void nbt_coder_encode_double(nbt_coder_t* coder, double item, nbt_byte_order_t order);
 void nbt_coder_encode_data(nbt_coder_t* coder, const char* data, size_t length);
 
+/*
+ * Append-only encoding. Always writes at the end of the coder and leaves the
+ * cursor there, so there's never anything to shift. Reserving the size of a
+ * run of appends up front means at most one reallocation for all of them.
+ */
+void nbt_coder_reserve(nbt_coder_t* coder, size_t length);
+void nbt_coder_append_byte(nbt_coder_t* coder, int8_t item);
+void nbt_coder_append_short(nbt_coder_t* coder, int16_t item, nbt_byte_order_t order);
+void nbt_coder_append_int(nbt_coder_t* coder, int32_t item, nbt_byte_order_t order);
+void nbt_coder_append_long(nbt_coder_t* coder, int64_t item, nbt_byte_order_t order);
+void nbt_coder_append_float(nbt_coder_t* coder, float item, nbt_byte_order_t order);
+void nbt_coder_append_double(nbt_coder_t* coder, double item, nbt_byte_order_t order);
+void nbt_coder_append_data(nbt_coder_t* coder, const char* data, size_t length);
+void nbt_coder_append_shorts(nbt_coder_t* coder, const int16_t* items, size_t count, nbt_byte_order_t order);
+void nbt_coder_append_ints(nbt_coder_t* coder, const int32_t* items, size_t count, nbt_byte_order_t order);
+void nbt_coder_append_longs(nbt_coder_t* coder, const int64_t* items, size_t count, nbt_byte_order_t order);
+
 /* Decoder */
 int8_t nbt_coder_decode_byte(nbt_coder_t* coder);
 int16_t nbt_coder_decode_short(nbt_coder_t* coder, nbt_byte_order_t order);
@@ -64,6 +132,9 @@ int64_t nbt_coder_decode_long(nbt_coder_t* coder, nbt_byte_order_t order);
 float nbt_coder_decode_float(nbt_coder_t* coder, nbt_byte_order_t order);
 double nbt_coder_decode_double(nbt_coder_t* coder, nbt_byte_order_t order);
 void nbt_coder_decode_data(nbt_coder_t* coder, char* buffer, size_t length);
+void nbt_coder_decode_shorts(nbt_coder_t* coder, int16_t* buffer, size_t count, nbt_byte_order_t order);
+void nbt_coder_decode_ints(nbt_coder_t* coder, int32_t* buffer, size_t count, nbt_byte_order_t order);
+void nbt_coder_decode_longs(nbt_coder_t* coder, int64_t* buffer, size_t count, nbt_byte_order_t order);
 
 /* Compression -- not in-place...should it be? */
 typedef enum {
@@ -71,8 +142,30 @@ typedef enum {
 	NBT_COMPRESSION_INFLATE	/* zlib header -- compress like a chunk */
 } nbt_compression_strategy_t;
 nbt_coder_t* nbt_coder_compress(nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy);
+
+/*
+ * The same stream compressed in 128K blocks on `threads` threads (0 means one
+ * per CPU). Each block is primed with the 32K before it, so the ratio stays
+ * close to nbt_coder_compress; the output is a single ordinary gzip or zlib
+ * stream. Small inputs just use nbt_coder_compress.
+ */
+nbt_coder_t* nbt_coder_compress_parallel(nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy, size_t threads);
 nbt_coder_t* nbt_coder_decompress(nbt_coder_t* coder);
 
+/*
+ * A sink that deflates everything appended to it into `destination` as it
+ * goes, instead of compressing a finished coder. The destination can be an
+ * ordinary coder or another sink; it's borrowed and flushed on finish.
+ */
+nbt_coder_t* nbt_coder_create_deflate(nbt_coder_t* destination, nbt_compression_strategy_t compression_strategy);
+
+/*
+ * Decompress into a buffer sized up front, so a correct size inflates in one
+ * call. An expected_size of 0 uses the gzip trailer (or a guess for zlib
+ * streams); if the size turns out too small the output grows geometrically.
+ */
+nbt_coder_t* nbt_coder_decompress_hint(nbt_coder_t* coder, size_t expected_size);
+
 __END_DECLS
 
 #endif /* coder_h */
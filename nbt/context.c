@@ -0,0 +1,149 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  context.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "internal.h"
+#include "coder.h"
+
+nbt_context_t* nbt_context_create() {
+	nbt_context_t* context = malloc(sizeof(*context));
+	_nbt_context_init(context);
+	return context;
+}
+
+void nbt_context_release(nbt_context_t* context) {
+	if (context) {
+		_nbt_context_clear(context);
+		free(context);
+	}
+}
+
+void _nbt_context_init(nbt_context_t* context) {
+	memset(context, 0, sizeof(*context));
+	context->budget = SIZE_MAX;
+}
+
+void _nbt_context_clear(nbt_context_t* context) {
+	free(context->name);
+	free(context->atoms);
+	if (context->inflate_ready) {
+		inflateEnd(&context->inflate);
+	}
+	for (size_t i = 0; i < sizeof(context->deflate) / sizeof(*context->deflate); i++) {
+		if (context->deflate_ready[i]) {
+			deflateEnd(&context->deflate[i]);
+		}
+	}
+	nbt_coder_release(context->view);
+	nbt_coder_release(context->inflated);
+	nbt_coder_release(context->written);
+	nbt_coder_release(context->compressed);
+	_nbt_context_init(context);
+}
+
+void nbt_context_set_options(nbt_context_t* context, const nbt_parse_options_t* options) {
+	if (options) {
+		context->options = *options;
+		if (options->flags & NBT_PARSE_BORROW) {
+			/* The arena is what keeps the borrowed input */
+			context->options.flags |= NBT_PARSE_ARENA;
+		}
+	} else {
+		memset(&context->options, 0, sizeof(context->options));
+	}
+}
+
+char* _nbt_context_grow(char** buffer, size_t* reserved, size_t length) {
+	size_t grown = *reserved ? *reserved : 64;
+	while (grown < length) {
+		if (grown > SIZE_MAX / 2) {
+			/* Doubling again would wrap, so just the length asked for */
+			grown = length;
+			break;
+		}
+		grown <<= 1;
+	}
+	char* grown_buffer = realloc(*buffer, grown);
+	assert(grown_buffer);
+	*buffer = grown_buffer;
+	*reserved = grown;
+	return *buffer;
+}
+
+nbt_coder_t* nbt_context_compress(nbt_context_t* context, nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy) {
+	z_stream* stream = &context->deflate[compression_strategy];
+	if (context->deflate_ready[compression_strategy]) {
+		deflateReset(stream);
+	} else {
+		/* Same settings as nbt_coder_compress */
+		int window_bits = 15;
+		if (compression_strategy == NBT_COMPRESSION_GZIP) {
+			window_bits += 16;
+		}
+		int zlib_ret = deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+		assert(zlib_ret == Z_OK);
+		(void)zlib_ret;
+		context->deflate_ready[compression_strategy] = true;
+	}
+	
+	if (context->compressed) {
+		nbt_coder_reset(context->compressed);
+	} else {
+		context->compressed = nbt_coder_create();
+	}
+	_nbt_coder_deflate_all(stream, coder, context->compressed);
+	return context->compressed;
+}
+
+nbt_coder_t* nbt_context_decompress(nbt_context_t* context, nbt_coder_t* coder) {
+	nbt_status_t status = _nbt_context_decompress(context, coder, 0);
+	assert(!status);
+	(void)status;
+	return context->inflated;
+}
+
+/* Into the context's inflate buffer */
+nbt_status_t _nbt_context_decompress(nbt_context_t* context, nbt_coder_t* coder, size_t limit) {
+	if (context->inflate_ready) {
+		inflateReset(&context->inflate);
+	} else {
+		/* automatic header detection */
+		int zlib_ret = inflateInit2(&context->inflate, 15 + 32);
+		assert(zlib_ret == Z_OK);
+		(void)zlib_ret;
+		context->inflate_ready = true;
+	}
+	
+	if (context->inflated) {
+		nbt_coder_reset(context->inflated);
+	} else {
+		context->inflated = nbt_coder_create();
+	}
+	return _nbt_coder_inflate_all(&context->inflate, coder, context->inflated, 0, limit);
+}
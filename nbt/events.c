@@ -0,0 +1,259 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  events.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* Deeper inputs move their stack to the heap */
+#define NBT_EVENT_INLINE_DEPTH 32
+
+/* An open container, its begin event goes back out as its end */
+struct nbt_event_frame {
+	nbt_event_t event;
+	int32_t remaining;	/* list elements still to come */
+};
+
+nbt_status_t _nbt_parse_events(nbt_coder_t* coder, nbt_byte_order_t order, nbt_event_handler_t handler, void* context);
+bool _nbt_event_fail(nbt_status_t* status);
+bool _nbt_event_name(nbt_event_t* event, nbt_coder_t* coder, nbt_byte_order_t order);
+bool _nbt_event_payload(nbt_event_t* event, nbt_coder_t* coder, nbt_byte_order_t order);
+
+nbt_status_t nbt_parse_events(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_event_handler_t handler, void* context) {
+	/* Just for the view and the inflate buffer, they live as long as this parse */
+	nbt_context_t parse_context;
+	_nbt_context_init(&parse_context);
+	nbt_status_t status = nbt_context_parse_events(&parse_context, bytes, length, order, compressed, handler, context);
+	_nbt_context_clear(&parse_context);
+	return status;
+}
+
+nbt_status_t nbt_context_parse_events(nbt_context_t* context, const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_event_handler_t handler, void* handler_context) {
+	if (context->view) {
+		_nbt_coder_view(context->view, bytes, length);
+	} else {
+		context->view = nbt_coder_create_borrowed(bytes, length);
+	}
+	nbt_coder_t* coder = context->view;
+	if (compressed) {
+		/* The events point into it, so it has to be inflated all at once */
+		nbt_status_t status = _nbt_context_decompress(context, coder, 0);
+		if (status) {
+			return status;
+		}
+		coder = context->inflated;
+	}
+	return _nbt_parse_events(coder, order, handler, handler_context);
+}
+
+nbt_status_t _nbt_parse_events(nbt_coder_t* coder, nbt_byte_order_t order, nbt_event_handler_t handler, void* context) {
+	struct nbt_event_frame inline_frames[NBT_EVENT_INLINE_DEPTH];
+	struct nbt_event_frame* frames = inline_frames;
+	size_t reserved = NBT_EVENT_INLINE_DEPTH;
+	size_t depth = 0;
+	size_t skipping = 0;	/* the depth of a container the handler skipped, nothing under it goes out */
+	nbt_status_t status = NBT_SUCCESS;
+	nbt_event_t event;
+	memset(&event, 0, sizeof(event));
+	bool next = false;
+	if (!_nbt_coder_ensure(coder, sizeof(int8_t))) {
+		_nbt_event_fail(&status);
+	} else if ((event.type = nbt_coder_decode_byte(coder)) != NBT_END) {
+		next = _nbt_event_name(&event, coder, order) || _nbt_event_fail(&status);
+	}
+	while (next) {
+		if (!_nbt_event_payload(&event, coder, order)) {
+			_nbt_event_fail(&status);
+			break;
+		}
+		bool container = event.kind == NBT_EVENT_BEGIN_COMPOUND || event.kind == NBT_EVENT_BEGIN_LIST;
+		nbt_walk_action_t action = skipping ? NBT_WALK_CONTINUE : handler(&event, context);
+		if (action == NBT_WALK_STOP) {
+			break;
+		}
+		if (container) {
+			if (depth == reserved) {
+				struct nbt_event_frame* grown = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				if (!grown) {
+					status = NBT_ERROR_MEMORY;
+					break;
+				}
+				frames = grown;
+			}
+			struct nbt_event_frame* frame = &frames[depth++];
+			frame->event = event;
+			frame->remaining = 0;
+			if (event.kind == NBT_EVENT_BEGIN_LIST && event.value.list.element_type != NBT_END && event.value.list.count > 0) {
+				frame->remaining = event.value.list.count;
+			}
+			if (action == NBT_WALK_SKIP) {
+				/* Still read through, so bad input inside it is caught, until its end goes out */
+				skipping = depth;
+			}
+			size_t width = event.kind == NBT_EVENT_BEGIN_LIST ? _nbt_packed_width(event.value.list.element_type) : 0;
+			if (skipping && width && frame->remaining) {
+				/* count x width, no need to look at the elements */
+				if (!_nbt_coder_skip_checked(coder, width * frame->remaining)) {
+					_nbt_event_fail(&status);
+					break;
+				}
+				frame->remaining = 0;
+			}
+		}
+		
+		/* The next tag, ending every container that runs out on the way */
+		next = false;
+		bool stopped = false;
+		while (depth && !next && !status) {
+			struct nbt_event_frame* frame = &frames[depth - 1];
+			memset(&event, 0, sizeof(event));
+			event.depth = depth;
+			if (frame->event.kind == NBT_EVENT_BEGIN_COMPOUND) {
+				if (!_nbt_coder_ensure(coder, sizeof(int8_t))) {
+					_nbt_event_fail(&status);
+					break;
+				}
+				event.type = nbt_coder_decode_byte(coder);
+				if (event.type != NBT_END) {
+					next = _nbt_event_name(&event, coder, order) || _nbt_event_fail(&status);
+					break;
+				}
+			} else if (frame->remaining > 0) {
+				event.type = frame->event.value.list.element_type;
+				event.index = frame->event.value.list.count - frame->remaining--;
+				next = true;
+			}
+			if (!next) {
+				if (skipping && depth > skipping) {
+					depth--;
+					continue;
+				}
+				skipping = 0;
+				depth--;
+				frame->event.kind = frame->event.kind == NBT_EVENT_BEGIN_COMPOUND ? NBT_EVENT_END_COMPOUND : NBT_EVENT_END_LIST;
+				if (handler(&frame->event, context) == NBT_WALK_STOP) {
+					stopped = true;
+					break;
+				}
+			}
+		}
+		if (stopped) {
+			break;
+		}
+	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+	return status;
+}
+
+bool _nbt_event_fail(nbt_status_t* status) {
+	*status = NBT_ERROR_FORMAT;
+	return false;
+}
+
+bool _nbt_event_name(nbt_event_t* event, nbt_coder_t* coder, nbt_byte_order_t order) {
+	if (!_nbt_coder_ensure(coder, sizeof(int16_t))) {
+		return false;
+	}
+	event->name_length = nbt_coder_decode_short(coder, order);
+	event->name = nbt_coder_data(coder) + _nbt_coder_tell(coder);
+	return _nbt_coder_skip_checked(coder, event->name_length);
+}
+
+/* Fills in the event for whatever's next, false if the input doesn't hold it */
+bool _nbt_event_payload(nbt_event_t* event, nbt_coder_t* coder, nbt_byte_order_t order) {
+	event->kind = NBT_EVENT_SCALAR;
+	/* Every scalar is as wide as it is packed */
+	size_t scalar = _nbt_packed_width(event->type);
+	if (scalar && !_nbt_coder_ensure(coder, scalar)) {
+		return false;
+	}
+	switch (event->type) {
+		case NBT_BYTE:
+			event->value.tag_byte = nbt_coder_decode_byte(coder);
+			return true;
+		case NBT_SHORT:
+			event->value.tag_short = nbt_coder_decode_short(coder, order);
+			return true;
+		case NBT_INT:
+			event->value.tag_int = nbt_coder_decode_int(coder, order);
+			return true;
+		case NBT_LONG:
+			event->value.tag_long = nbt_coder_decode_long(coder, order);
+			return true;
+		case NBT_FLOAT:
+			event->value.tag_float = nbt_coder_decode_float(coder, order);
+			return true;
+		case NBT_DOUBLE:
+			event->value.tag_double = nbt_coder_decode_double(coder, order);
+			return true;
+		case NBT_STRING:
+			if (!_nbt_coder_ensure(coder, sizeof(int16_t))) {
+				return false;
+			}
+			event->kind = NBT_EVENT_STRING;
+			event->value.string.length = nbt_coder_decode_short(coder, order);
+			event->value.string.bytes = nbt_coder_data(coder) + _nbt_coder_tell(coder);
+			return _nbt_coder_skip_checked(coder, event->value.string.length);
+		case NBT_BYTE_ARRAY:
+		case NBT_INT_ARRAY:
+		case NBT_LONG_ARRAY: {
+			if (!_nbt_coder_ensure(coder, sizeof(int32_t))) {
+				return false;
+			}
+			int32_t length = nbt_coder_decode_int(coder, order);
+			if (length < 0) {
+				return false;
+			}
+			size_t width = event->type == NBT_BYTE_ARRAY ? sizeof(int8_t) : event->type == NBT_INT_ARRAY ? sizeof(int32_t) : sizeof(int64_t);
+			event->kind = NBT_EVENT_ARRAY;
+			event->value.array.elements = nbt_coder_data(coder) + _nbt_coder_tell(coder);
+			event->value.array.length = length;
+			event->value.array.order = order;
+			return _nbt_coder_skip_checked(coder, width * length);
+		}
+		case NBT_LIST: {
+			if (!_nbt_coder_ensure(coder, sizeof(int8_t) + sizeof(int32_t))) {
+				return false;
+			}
+			event->kind = NBT_EVENT_BEGIN_LIST;
+			event->value.list.element_type = nbt_coder_decode_byte(coder);
+			event->value.list.count = nbt_coder_decode_int(coder, order);
+			/* Empty lists are allowed to say END */
+			bool empty = event->value.list.count == 0 && event->value.list.element_type == NBT_END;
+			nbt_type_t element_type = event->value.list.element_type;
+			return event->value.list.count >= 0 && (empty || (element_type >= NBT_BYTE && element_type <= NBT_LONG_ARRAY));
+		}
+		case NBT_COMPOUND:
+			event->kind = NBT_EVENT_BEGIN_COMPOUND;
+			return true;
+		default:
+			/* END only ever closes a compound, anything else isn't a tag */
+			return false;
+	}
+}
@@ -34,12 +34,40 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
 
+/* Node flags */
+enum {
+	NBT_FLAG_ARENA		= 1 << 0,	/* the node and everything it owns came from an arena */
+	NBT_FLAG_ARENA_ROOT	= 1 << 1,	/* releasing the node releases the arena */
+	NBT_FLAG_ATOM		= 1 << 2,	/* the name is an atom, it isn't the node's to free */
+	NBT_FLAG_NAMED		= 1 << 3,	/* list elements and the like have no name at all, not even an empty one */
+	NBT_FLAG_PACKED		= 1 << 4,	/* a list of fixed width elements kept as a flat array of native values */
+	NBT_FLAG_DEFERRED	= 1 << 5,	/* a lazy parse hasn't decoded the payload yet, see _nbt_materialize */
+	NBT_FLAG_BORROWED	= 1 << 6	/* the string or byte array points into the input, see NBT_PARSE_BORROW */
+};
+
+/* Names shorter than this (most keys) are stored in the node itself */
+#define NBT_INLINE_NAME 8
+
+typedef struct nbt_arena nbt_arena_t;
+typedef struct nbt_source nbt_source_t;
+
+/* 48 bytes on 64-bit platforms: an 8 byte header, the name, a 16 byte payload and the siblings */
 struct _nbt {
-	nbt_type_t type;
-	char* name;
+	int8_t type;	/* an nbt_type_t */
+	uint8_t flags;
+	uint16_t name_length;
+	int8_t element_type;	/* lists only, it lives up here so the list payload fits in 16 bytes */
+	
+	/* See _nbt_name_bytes, a long name is on the heap, in the arena or an atom */
+	union {
+		char* pointer;
+		char bytes[NBT_INLINE_NAME];
+	} name;
 	
 	union nbt_payload {
 		int8_t tag_byte;
@@ -54,25 +82,271 @@ struct _nbt {
 			int8_t* byte_array;
 		} tag_byte_array;
 		
-		char* tag_string;
+		struct nbt_string {
+			uint16_t length;
+			uint8_t copy;	/* how far a borrowed string is with a copy of its own, see nbt_string */
+			char* string;	/* also NUL terminated for nbt_string, unless it's borrowed */
+		} tag_string;
 		
 		struct nbt_list {
-			int8_t type;
-			nbt_t* tree;
+			int32_t count;
+			int32_t reserved;
+			union {
+				nbt_t** items;
+				void* values;
+			} elements;
 		} tag_list;
 		
-		nbt_t* tag_compound;
+		struct nbt_compound {
+			nbt_t* head;	/* the head's tree_left is the tail, so appends don't walk the children */
+			struct nbt_compound_index* index;	/* by name, once lookups get long */
+		} tag_compound;
 		
 		struct nbt_int_array {
 			int32_t length;
 			int32_t* int_array;
 		} tag_int_array;
+		
+		struct nbt_long_array {
+			int32_t length;
+			nbt_byte_order_t order;	/* the elements may still be in wire order */
+			int64_t* long_array;
+		} tag_long_array;
+		
+		struct nbt_deferred {
+			nbt_source_t* source;
+			size_t offset;	/* of the payload in the source */
+		} tag_deferred;
 	} payload;
 	
 	nbt_t* tree_left;
 	nbt_t* tree_right;
 };
 
+struct _nbt_context {
+	/* Scratch for names while they're decoded, only ever grows */
+	char* name;
+	size_t name_reserved;
+	
+	nbt_parse_options_t options;
+	nbt_arena_t* arena;	/* only while an arena parse is running */
+	nbt_source_t* source;	/* only in a lazy source's own context, payloads are deferred instead of decoded */
+	
+	/* Set by a limited parse that ran out, which stops it wherever it is */
+	nbt_status_t status;
+	size_t budget;	/* bytes the tree can still allocate */
+	size_t* shared_budget;	/* spent from instead by the workers of a limited parallel parse */
+	
+	/* Atoms this context has already looked up, so it doesn't have to take the global lock */
+	struct nbt_atom** atoms;
+	size_t atoms_mask;
+	size_t atoms_count;
+	
+	/* Set up on first use and reset between uses, deflate is per strategy */
+	z_stream inflate;
+	bool inflate_ready;
+	z_stream deflate[2];
+	bool deflate_ready[2];
+	
+	/* Handed back to the caller, valid until the next call that fills them */
+	nbt_coder_t* view;
+	nbt_coder_t* inflated;
+	nbt_coder_t* written;
+	nbt_coder_t* compressed;
+};
+
+/* Always valid, the names of unnamed nodes are empty */
+static inline const char* _nbt_name_bytes(const nbt_t* tag) {
+	return tag->name_length < NBT_INLINE_NAME ? tag->name.bytes : tag->name.pointer;
+}
+
+static inline const char* _nbt_name(const nbt_t* tag) {
+	return tag->flags & NBT_FLAG_NAMED ? _nbt_name_bytes(tag) : NULL;
+}
+
+nbt_t* _nbt_create_named(nbt_type_t type, const char* name);
+nbt_t* _nbt_create_owned(nbt_t* owner, nbt_type_t type, const char* name);
+nbt_t* _nbt_create_in(nbt_arena_t* arena, nbt_type_t type, const char* name, size_t name_length);
+void _nbt_set_name(nbt_t* tag, const char* name, size_t length);
+void* _nbt_alloc(nbt_t* owner, size_t size);
+void _nbt_free(nbt_t* owner, void* pointer);
 int32_t _nbt_tree_count(nbt_t* node);
+void _nbt_list_reserve(nbt_t* list, int32_t count);
+size_t _nbt_packed_width(nbt_type_t type);
+nbt_t* _nbt_list_element(nbt_t* list, int32_t index, nbt_t* scratch);
+
+/*
+ * A long array in the other byte order is one block: a header saying whether
+ * the native copy's been made, the wire bytes the payload points at, and room
+ * for the copy, so reading it never changes what's already there.
+ */
+size_t _nbt_long_array_size(int32_t length, nbt_byte_order_t order);
+int64_t* _nbt_long_array_alloc(nbt_t* tag, int32_t length, nbt_byte_order_t order);
+
+/* A parse that goes wrong stops with context->status set, which _nbt_parse_root hands back to the caller */
+nbt_t* _nbt_parse_payload(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+nbt_t* _nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+nbt_t* _nbt_parse_header(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+nbt_t* _nbt_parse_child(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+void _nbt_parse_name(nbt_t* tag, const char* name, size_t length, nbt_context_t* context);
+int32_t _nbt_parse_reserve(nbt_coder_t* coder, int32_t count);
+nbt_t* _nbt_parse_tree(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+void _nbt_skip_payload(nbt_coder_t* coder, nbt_type_t type, nbt_byte_order_t order);
+nbt_t* _nbt_parse_projected_root(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+
+/*
+ * NBT_PARSE_PARALLEL: a skip pass splits the root's payload, and any child
+ * too big to be one piece, into runs of elements that are decoded on their
+ * own threads, each into its own arena, and stitched back in input order.
+ */
+nbt_t* _nbt_parse_split(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+
+bool _nbt_parse_spend_shared(nbt_context_t* context, size_t bytes);
+
+/* Counts bytes against a limited parse's budget, the rest have SIZE_MAX to spend */
+static inline bool _nbt_parse_spend(nbt_context_t* context, size_t bytes) {
+	if (context->shared_budget) {
+		return _nbt_parse_spend_shared(context, bytes);
+	}
+	if (bytes > context->budget) {
+		context->status = NBT_ERROR_LIMIT;
+		return false;
+	}
+	context->budget -= bytes;
+	return true;
+}
+
+void _nbt_context_init(nbt_context_t* context);
+void _nbt_context_clear(nbt_context_t* context);
+nbt_status_t _nbt_context_decompress(nbt_context_t* context, nbt_coder_t* coder, size_t limit);
+char* _nbt_context_grow(char** buffer, size_t* reserved, size_t length);
+
+static inline char* _nbt_context_scratch(char** buffer, size_t* reserved, size_t length) {
+	return *reserved >= length ? *buffer : _nbt_context_grow(buffer, reserved, length);
+}
+
+/*
+ * Bump allocation out of 64K slabs aligned to their size. Nothing is freed
+ * until the whole arena is. A tree that's had heap nodes linked into it is
+ * marked mixed, so releasing it knows it has to walk the tree first.
+ */
+nbt_arena_t* _nbt_arena_create();
+void _nbt_arena_release(nbt_arena_t* arena);
+void* _nbt_arena_alloc(nbt_arena_t* arena, size_t size);
+nbt_arena_t* _nbt_arena_of(const void* pointer);
+void _nbt_arena_mix(nbt_arena_t* arena);
+bool _nbt_arena_mixed(nbt_arena_t* arena);
+void _nbt_arena_keep(nbt_arena_t* arena, nbt_source_t* source);
+
+/*
+ * A block made off the arena, safe from any thread, that attaching hands to
+ * the arena to free with the rest. Attaching can race with other attaches,
+ * but not with allocating from the arena.
+ */
+void* _nbt_arena_block_create(size_t size);
+void _nbt_arena_block_release(void* data);
+void _nbt_arena_attach(nbt_arena_t* arena, void* data);
+
+/* Takes over other's slabs and blocks, so other's nodes belong to arena from then on */
+void _nbt_arena_adopt(nbt_arena_t* arena, nbt_arena_t* other);
+
+/*
+ * Lazy parsing. A source is the whole uncompressed input, counted by the heap
+ * nodes still deferred into it (arena nodes share one count, the arena's).
+ * Borrowing parses of input they can't point into keep one as well, only
+ * ever held by their arena.
+ * Materializing decodes a deferred node's payload, deferring its children in
+ * turn.
+ */
+nbt_t* _nbt_parse_lazy(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+nbt_t* _nbt_parse_borrowed(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+void _nbt_source_retain(nbt_source_t* source);
+void _nbt_source_release(nbt_source_t* source);
+void _nbt_defer(nbt_t* tag, nbt_source_t* source, size_t offset);
+void _nbt_materialize(nbt_t* tag);
+const char* _nbt_deferred_payload(nbt_t* tag, size_t* length, nbt_byte_order_t* order);
+
+/* Anything that hands a node out makes sure it's been decoded first */
+static inline nbt_t* _nbt_decoded(nbt_t* tag) {
+	if (tag && tag->flags & NBT_FLAG_DEFERRED) {
+		_nbt_materialize(tag);
+	}
+	return tag;
+}
+
+/* nbt_string can swap a borrowed string for its copy while other threads read it, either one is the same string */
+static inline const char* _nbt_string_bytes(const nbt_t* tag) {
+	return __atomic_load_n(&tag->payload.tag_string.string, __ATOMIC_ACQUIRE);
+}
+
+/* FNV-1a, atoms and compound indices share it */
+static inline uint32_t _nbt_hash_bytes(const char* bytes, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/* An interned name, a node's name points at name and never owns it */
+struct nbt_atom {
+	uint32_t hash;
+	uint32_t length;
+	char name[];
+};
+
+static inline struct nbt_atom* _nbt_atom_of(const char* name) {
+	return (struct nbt_atom*)(name - offsetof(struct nbt_atom, name));
+}
+
+/* NULL if the name is too long to be worth interning or the table is full */
+const char* _nbt_context_atom(nbt_context_t* context, const char* name, size_t length);
+
+/* How _nbt_walk treats the nodes nbt_walk would have to change or make up */
+typedef enum {
+	NBT_WALK_PACKED_ELEMENTS	= 1 << 0,	/* visit packed elements in a temporary tag, instead of leaving packed lists as leaves */
+	NBT_WALK_DEFERRED			= 1 << 1	/* hand deferred nodes over as they are instead of decoding them */
+} nbt_walk_flags_t;
+
+bool _nbt_walk(nbt_t* tag, nbt_visitor_t pre, nbt_visitor_t post, void* context, nbt_walk_flags_t flags);
+
+/*
+ * Twice the room for a stack of size-byte frames that starts out in
+ * inline_frames (or NULL), moving it to the heap the first time. NULL if that
+ * can't be had, with frames and reserved left as they were.
+ */
+void* _nbt_frames_grow(void* frames, const void* inline_frames, size_t* reserved, size_t size);
+
+#ifdef __GNUC__
+# define _nbt_prefetch(address) __builtin_prefetch(address)
+#else
+# define _nbt_prefetch(address) ((void)(address))
+#endif
+
+/*
+ * Whole-buffer zlib on a stream the caller set up, appending to ret_coder.
+ * Inflating returns NBT_ERROR_ZLIB for bad or cut off data, NBT_ERROR_LIMIT
+ * once the output passes limit bytes (0 for no limit) and NBT_ERROR_MEMORY if
+ * the output can't grow.
+ */
+nbt_status_t _nbt_coder_inflate_all(z_stream* stream, nbt_coder_t* coder, nbt_coder_t* ret_coder, size_t expected_size, size_t limit);
+void _nbt_coder_deflate_all(z_stream* stream, nbt_coder_t* coder, nbt_coder_t* ret_coder);
+void _nbt_coder_view(nbt_coder_t* coder, const char* data, size_t size);
+
+/* Moving around the input without decoding it, only whole-buffer coders can seek */
+bool _nbt_coder_whole(nbt_coder_t* coder);
+size_t _nbt_coder_tell(nbt_coder_t* coder);
+void _nbt_coder_seek(nbt_coder_t* coder, size_t offset);
+void _nbt_coder_skip(nbt_coder_t* coder, size_t length);
+
+/* False instead of asserting when the input runs out; a stream can only ensure up to its window */
+bool _nbt_coder_skip_checked(nbt_coder_t* coder, size_t length);
+bool _nbt_coder_ensure(nbt_coder_t* coder, size_t length);
+
+/* An owned copy of everything left to decode, streams are read to the end */
+nbt_coder_t* _nbt_coder_drain(nbt_coder_t* coder);
+
+/* The same appended to drained, false once it comes to more than limit bytes (0 for no limit) */
+bool _nbt_coder_drain_into(nbt_coder_t* coder, nbt_coder_t* drained, size_t limit);
 
 #endif /* internal_h */
@@ -0,0 +1,149 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  lazy.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* The uncompressed input of a lazy or borrowing parse, kept until nothing defers into or borrows from it */
+struct nbt_source {
+	nbt_coder_t* data;
+	nbt_coder_t* view;	/* borrowed over data, materializing decodes through it */
+	nbt_byte_order_t order;
+	size_t references;
+	nbt_context_t context;	/* the parse's options, plus scratch and atoms for materializing */
+};
+
+nbt_source_t* _nbt_source_create(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+
+nbt_t* _nbt_parse_lazy(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	nbt_source_t* source = _nbt_source_create(coder, order, context);
+	nbt_arena_t* arena = NULL;
+	if (context->options.flags & NBT_PARSE_ARENA) {
+		arena = _nbt_arena_create();
+		_nbt_arena_keep(arena, source);
+	}
+	source->context.arena = arena;
+	source->context.source = source;
+	/* The root is deferred like everything else, then decoded straight away, unless it's a number that never was */
+	nbt_t* tag = _nbt_parse_coder(source->view, order, &source->context);
+	if (tag) {
+		if (tag->flags & NBT_FLAG_DEFERRED) {
+			_nbt_materialize(tag);
+		}
+		if (arena) {
+			tag->flags |= NBT_FLAG_ARENA_ROOT;
+		}
+	} else if (arena) {
+		_nbt_arena_release(arena);
+	}
+	_nbt_source_release(source);
+	return tag;
+}
+
+/* An ordinary arena parse over the source, the arena's hold on it is the only one */
+nbt_t* _nbt_parse_borrowed(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	nbt_source_t* source = _nbt_source_create(coder, order, context);
+	context->arena = _nbt_arena_create();
+	_nbt_arena_keep(context->arena, source);
+	nbt_t* tag = _nbt_parse_tree(source->view, order, context);
+	if (tag) {
+		tag->flags |= NBT_FLAG_ARENA_ROOT;
+	} else {
+		_nbt_arena_release(context->arena);
+	}
+	context->arena = NULL;
+	_nbt_source_release(source);
+	return tag;
+}
+
+/* Holds one reference for the parse that makes it */
+nbt_source_t* _nbt_source_create(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	nbt_source_t* source = malloc(sizeof(*source));
+	if (coder == context->inflated && !_nbt_coder_tell(coder)) {
+		/* Already a copy nobody else needs, the context makes itself another next time */
+		source->data = coder;
+		context->inflated = NULL;
+	} else {
+		source->data = _nbt_coder_drain(coder);
+	}
+	source->view = nbt_coder_create_borrowed(nbt_coder_data(source->data), nbt_coder_size(source->data));
+	source->order = order;
+	/* The parse's own, so a lazy root can be materialized before anything else holds one */
+	source->references = 1;
+	_nbt_context_init(&source->context);
+	nbt_context_set_options(&source->context, &context->options);
+	return source;
+}
+
+void _nbt_source_retain(nbt_source_t* source) {
+	source->references++;
+}
+
+void _nbt_source_release(nbt_source_t* source) {
+	if (--source->references) {
+		return;
+	}
+	_nbt_context_clear(&source->context);
+	nbt_coder_release(source->view);
+	nbt_coder_release(source->data);
+	free(source);
+}
+
+void _nbt_defer(nbt_t* tag, nbt_source_t* source, size_t offset) {
+	tag->flags |= NBT_FLAG_DEFERRED;
+	tag->payload.tag_deferred.source = source;
+	tag->payload.tag_deferred.offset = offset;
+	if (!(tag->flags & NBT_FLAG_ARENA)) {
+		_nbt_source_retain(source);
+	}
+}
+
+void _nbt_materialize(nbt_t* tag) {
+	nbt_source_t* source = tag->payload.tag_deferred.source;
+	_nbt_coder_seek(source->view, tag->payload.tag_deferred.offset);
+	tag->flags &= ~NBT_FLAG_DEFERRED;
+	memset(&tag->payload, 0, sizeof(tag->payload));
+	/* The children come from wherever the node did */
+	source->context.arena = tag->flags & NBT_FLAG_ARENA ? _nbt_arena_of(tag) : NULL;
+	_nbt_parse_payload(tag, source->view, source->order, &source->context);
+	source->context.arena = NULL;
+	if (!(tag->flags & NBT_FLAG_ARENA)) {
+		_nbt_source_release(source);
+	}
+}
+
+/* The payload's bytes as they are in the source, a deferred node can't have been changed */
+const char* _nbt_deferred_payload(nbt_t* tag, size_t* length, nbt_byte_order_t* order) {
+	nbt_source_t* source = tag->payload.tag_deferred.source;
+	size_t offset = tag->payload.tag_deferred.offset;
+	_nbt_coder_seek(source->view, offset);
+	_nbt_skip_payload(source->view, tag->type, source->order);
+	*length = _nbt_coder_tell(source->view) - offset;
+	*order = source->order;
+	return nbt_coder_data(source->data) + offset;
+}
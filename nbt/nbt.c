@@ -29,11 +29,67 @@
 
 #include "internal.h"
 
-nbt_t* _nbt_tree_index(nbt_t* node, int32_t index);
-nbt_t* _nbt_tree_end(nbt_t* node);
-nbt_t* _nbt_tree_name(nbt_t* node, const char* name);
-void _nbt_tree_remove(nbt_t* node);
-void _nbt_tree_replace(nbt_t* current, nbt_t* replacement);
+#include <sched.h>
+
+/* In front of a long array kept in the other byte order, see _nbt_long_array_alloc */
+#define NBT_LONG_ARRAY_HEADER 16
+
+/* What the header says about the native copy */
+enum {
+	NBT_LONG_ARRAY_WIRE,
+	NBT_LONG_ARRAY_SWAPPING,
+	NBT_LONG_ARRAY_NATIVE
+};
+
+/* How far a borrowed string is with its copy */
+enum {
+	NBT_STRING_BORROWED,
+	NBT_STRING_COPYING,
+	NBT_STRING_COPIED
+};
+
+/* Room in front of a packed list's values for a struct nbt_list_header, which keeps doubles aligned */
+#define NBT_LIST_HEADER 16
+
+struct nbt_list_header {
+	struct nbt_list_nodes* nodes;	/* the ones nbt_list_index hands out */
+	nbt_t* added;	/* items nbt_list_add took the values of, chained by tree_right and kept until the list goes */
+};
+
+/* Built once and left alone until the list goes, so other threads can keep the nodes they were given */
+struct nbt_list_nodes {
+	struct nbt_list_nodes* older;	/* made before the list last changed */
+	bool stale;
+	nbt_t* items[];	/* followed by the nodes themselves */
+};
+
+/* Compounds with more children than this get indexed the first time a lookup walks past them */
+#define NBT_COMPOUND_INDEX_THRESHOLD 16
+
+/* Open addressing by name with linear probing, the chain still keeps the order */
+struct nbt_compound_index {
+	size_t count;
+	size_t mask;
+	nbt_t* slots[];
+};
+
+nbt_t* _nbt_compound_find(nbt_t* compound, const char* name, size_t length);
+void _nbt_compound_append(nbt_t* compound, nbt_t* item);
+void _nbt_compound_unlink(nbt_t* compound, nbt_t* node);
+nbt_walk_action_t _nbt_release_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+nbt_walk_action_t _nbt_copy_payload(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+nbt_walk_action_t _nbt_release_node(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+void* _nbt_list_values(nbt_t* list, nbt_type_t type);
+struct nbt_list_header* _nbt_list_header(nbt_t* list);
+struct nbt_list_nodes* _nbt_list_nodes(nbt_t* list);
+void _nbt_list_changed(nbt_t* list);
+void _nbt_list_release_nodes(nbt_t* list);
+void _nbt_list_release_added(nbt_t* list);
+uint32_t _nbt_node_hash(nbt_t* node);
+void _nbt_index_build(nbt_t* compound, size_t count);
+nbt_t** _nbt_index_slot(struct nbt_compound_index* index, const char* name, size_t length, uint32_t hash);
+void _nbt_index_insert(nbt_t* compound, nbt_t* node);
+void _nbt_index_remove(struct nbt_compound_index* index, nbt_t* node);
 
 nbt_t* nbt_create() {
 	nbt_t* tag = malloc(sizeof(*tag));
@@ -41,82 +97,107 @@ nbt_t* nbt_create() {
 	return tag;
 }
 
-nbt_t* nbt_create_byte(const char* name, int8_t payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_BYTE;
+nbt_t* _nbt_create_named(nbt_type_t type, const char* name) {
+	return _nbt_create_in(NULL, type, name, name ? strlen(name) : 0);
+}
+
+/* A node that lives wherever owner does, the heap if there's no owner */
+nbt_t* _nbt_create_owned(nbt_t* owner, nbt_type_t type, const char* name) {
+	nbt_arena_t* arena = owner && owner->flags & NBT_FLAG_ARENA ? _nbt_arena_of(owner) : NULL;
+	return _nbt_create_in(arena, type, name, name ? strlen(name) : 0);
+}
+
+nbt_t* _nbt_create_in(nbt_arena_t* arena, nbt_type_t type, const char* name, size_t name_length) {
+	nbt_t* tag;
+	if (arena) {
+		tag = _nbt_arena_alloc(arena, sizeof(*tag));
+		memset(tag, 0, sizeof(*tag));
+		tag->flags = NBT_FLAG_ARENA;
+	} else {
+		tag = nbt_create();
+	}
+	tag->type = type;
 	if (name) {
-		tag->name = strdup(name);
+		_nbt_set_name(tag, name, name_length);
+	}
+	return tag;
+}
+
+/* Only for a node that doesn't have a name yet; the name doesn't need to be NUL terminated */
+void _nbt_set_name(nbt_t* tag, const char* name, size_t length) {
+	assert(length <= UINT16_MAX);
+	tag->flags |= NBT_FLAG_NAMED;
+	tag->name_length = length;
+	char* copy = tag->name.bytes;
+	if (length >= NBT_INLINE_NAME) {
+		copy = tag->name.pointer = _nbt_alloc(tag, length + 1);
+	}
+	memcpy(copy, name, length);
+	copy[length] = '\0';
+}
+
+/* Memory for something owner holds on to */
+void* _nbt_alloc(nbt_t* owner, size_t size) {
+	if (owner->flags & NBT_FLAG_ARENA) {
+		return _nbt_arena_alloc(_nbt_arena_of(owner), size);
 	}
+	return malloc(size);
+}
+
+void _nbt_free(nbt_t* owner, void* pointer) {
+	if (!(owner->flags & NBT_FLAG_ARENA)) {
+		free(pointer);
+	}
+}
+
+nbt_t* nbt_create_byte(const char* name, int8_t payload) {
+	nbt_t* tag = _nbt_create_named(NBT_BYTE, name);
 	tag->payload.tag_byte = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_short(const char* name, int16_t payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_SHORT;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_SHORT, name);
 	tag->payload.tag_short = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_int(const char* name, int32_t payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_INT;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_INT, name);
 	tag->payload.tag_int = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_long(const char* name, int64_t payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_LONG;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_LONG, name);
 	tag->payload.tag_long = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_float(const char* name, float payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_FLOAT;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_FLOAT, name);
 	tag->payload.tag_float = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_double(const char* name, double payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_DOUBLE;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_DOUBLE, name);
 	tag->payload.tag_double = payload;
 	return tag;
 }
 
 nbt_t* nbt_create_string(const char* name, const char* payload) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_STRING;
-	if (name) {
-		tag->name = strdup(name);
-	}
-	tag->payload.tag_string = strdup(payload);
+	nbt_t* tag = _nbt_create_named(NBT_STRING, name);
+	size_t length = strlen(payload);
+	assert(length <= UINT16_MAX);
+	tag->payload.tag_string.length = length;
+	tag->payload.tag_string.string = malloc(length + 1);
+	memcpy(tag->payload.tag_string.string, payload, length + 1);
 	return tag;
 }
 
 nbt_t* nbt_create_byte_array(const char* name, const int8_t* bytes, int32_t length) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_BYTE_ARRAY;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_BYTE_ARRAY, name);
 	tag->payload.tag_byte_array.length = length;
 	tag->payload.tag_byte_array.byte_array = malloc(sizeof(int8_t) * length);
 	memcpy(tag->payload.tag_byte_array.byte_array, bytes, sizeof(int8_t) * length);
@@ -124,59 +205,110 @@ nbt_t* nbt_create_byte_array(const char* name, const int8_t* bytes, int32_t leng
 }
 
 nbt_t* nbt_create_int_array(const char* name, const int32_t* ints, int32_t length) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_INT_ARRAY;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_INT_ARRAY, name);
 	tag->payload.tag_int_array.length = length;
 	tag->payload.tag_int_array.int_array = malloc(sizeof(int32_t) * length);
 	memcpy(tag->payload.tag_int_array.int_array, ints, sizeof(int32_t) * length);
 	return tag;
 }
 
+nbt_t* nbt_create_long_array(const char* name, const int64_t* longs, int32_t length) {
+	nbt_t* tag = _nbt_create_named(NBT_LONG_ARRAY, name);
+	tag->payload.tag_long_array.length = length;
+	tag->payload.tag_long_array.order = nbt_native_byte_order;
+	tag->payload.tag_long_array.long_array = malloc(sizeof(int64_t) * length);
+	memcpy(tag->payload.tag_long_array.long_array, longs, sizeof(int64_t) * length);
+	return tag;
+}
+
 nbt_t* nbt_create_list(const char* name, nbt_type_t type) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_LIST;
-	if (name) {
-		tag->name = strdup(name);
+	nbt_t* tag = _nbt_create_named(NBT_LIST, name);
+	tag->element_type = type;
+	if (_nbt_packed_width(type)) {
+		/* Always, so reading a list never has to change how it's stored */
+		tag->flags |= NBT_FLAG_PACKED;
 	}
-	tag->payload.tag_list.type = type;
 	return tag;
 }
 
 nbt_t* nbt_create_compound(const char* name) {
-	nbt_t* tag = nbt_create();
-	tag->type = NBT_COMPOUND;
-	if (name) {
-		tag->name = strdup(name);
-	}
+	nbt_t* tag = _nbt_create_named(NBT_COMPOUND, name);
 	return tag;
 }
 
 void nbt_release(nbt_t* tag) {
 	if (tag) {
+		if (tag->flags & NBT_FLAG_ARENA_ROOT && !_nbt_arena_mixed(_nbt_arena_of(tag))) {
+			/* Nothing in the tree is on the heap */
+			_nbt_arena_release(_nbt_arena_of(tag));
+			return;
+		}
+		/* Children go first, the walk has already moved past a node when it's released */
+		_nbt_walk(tag, _nbt_release_enter, _nbt_release_node, NULL, NBT_WALK_DEFERRED);
+	}
+}
+
+nbt_walk_action_t _nbt_release_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	if (tag->flags & NBT_FLAG_ARENA && !(tag->flags & NBT_FLAG_ARENA_ROOT) && !_nbt_arena_mixed(_nbt_arena_of(tag))) {
+		/* Nothing under it is on the heap either */
+		return NBT_WALK_SKIP;
+	}
+	return NBT_WALK_CONTINUE;
+}
+
+/* Everything but the children */
+nbt_walk_action_t _nbt_release_node(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	if (tag->flags & NBT_FLAG_DEFERRED) {
+		/* Nothing of its own yet, just its hold on the source */
+		if (!(tag->flags & NBT_FLAG_ARENA)) {
+			_nbt_source_release(tag->payload.tag_deferred.source);
+		}
+	} else {
 		switch (tag->type) {
 			case NBT_BYTE_ARRAY:
-				free(tag->payload.tag_byte_array.byte_array);
+				_nbt_free(tag, tag->payload.tag_byte_array.byte_array);
 				break;
 			case NBT_STRING:
-				free(tag->payload.tag_string);
+				_nbt_free(tag, tag->payload.tag_string.string);
 				break;
 			case NBT_LIST:
-				nbt_release(tag->payload.tag_list.tree);
+				if (tag->flags & NBT_FLAG_PACKED && tag->payload.tag_list.elements.values) {
+					_nbt_list_release_added(tag);
+					if (!(tag->flags & NBT_FLAG_ARENA)) {
+						_nbt_list_release_nodes(tag);
+					}
+					_nbt_free(tag, (char*)tag->payload.tag_list.elements.values - NBT_LIST_HEADER);
+				} else {
+					_nbt_free(tag, tag->payload.tag_list.elements.values);
+				}
 				break;
 			case NBT_COMPOUND:
-				nbt_release(tag->payload.tag_compound);
+				_nbt_free(tag, tag->payload.tag_compound.index);
 				break;
 			case NBT_INT_ARRAY:
-				free(tag->payload.tag_int_array.int_array);
+				_nbt_free(tag, tag->payload.tag_int_array.int_array);
+				break;
+			case NBT_LONG_ARRAY: {
+				struct nbt_long_array* array = &tag->payload.tag_long_array;
+				/* A parse that stopped early may not have got to the array */
+				if (array->long_array) {
+					_nbt_free(tag, array->order == nbt_native_byte_order ? (char*)array->long_array : (char*)array->long_array - NBT_LONG_ARRAY_HEADER);
+				}
 				break;
+			}
 			default:
 				break;
 		}
+	}
+	if (tag->flags & NBT_FLAG_ARENA_ROOT) {
+		_nbt_arena_release(_nbt_arena_of(tag));
+	} else if (!(tag->flags & NBT_FLAG_ARENA)) {
+		if (tag->name_length >= NBT_INLINE_NAME && !(tag->flags & NBT_FLAG_ATOM)) {
+			free(tag->name.pointer);
+		}
 		free(tag);
 	}
+	return NBT_WALK_CONTINUE;
 }
 
 int8_t nbt_byte(nbt_t* tag) {
@@ -227,130 +359,581 @@ const int32_t* nbt_int_array(nbt_t* tag) {
 	return tag->payload.tag_int_array.int_array;
 }
 
+const int64_t* nbt_long_array(nbt_t* tag) {
+	assert(tag);
+	assert(tag->type == NBT_LONG_ARRAY);
+	struct nbt_long_array* array = &tag->payload.tag_long_array;
+	if (array->order == nbt_native_byte_order) {
+		return array->long_array;
+	}
+	/* The first reader swaps into the copy, any others wait for it rather than touching the wire bytes */
+	int* state = (int*)((char*)array->long_array - NBT_LONG_ARRAY_HEADER);
+	int64_t* native = array->long_array + array->length;
+	int expected = NBT_LONG_ARRAY_WIRE;
+	if (__atomic_load_n(state, __ATOMIC_ACQUIRE) != NBT_LONG_ARRAY_NATIVE) {
+		if (__atomic_compare_exchange_n(state, &expected, NBT_LONG_ARRAY_SWAPPING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			nbt_swap_longs(native, array->long_array, array->length);
+			__atomic_store_n(state, NBT_LONG_ARRAY_NATIVE, __ATOMIC_RELEASE);
+		} else {
+			while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != NBT_LONG_ARRAY_NATIVE) {
+				sched_yield();
+			}
+		}
+	}
+	return native;
+}
+
+size_t _nbt_long_array_size(int32_t length, nbt_byte_order_t order) {
+	if (order == nbt_native_byte_order) {
+		return sizeof(int64_t) * (size_t)length;
+	}
+	return NBT_LONG_ARRAY_HEADER + 2 * sizeof(int64_t) * (size_t)length;
+}
+
+/* Sets up the payload and hands back where the wire bytes go */
+int64_t* _nbt_long_array_alloc(nbt_t* tag, int32_t length, nbt_byte_order_t order) {
+	struct nbt_long_array* array = &tag->payload.tag_long_array;
+	char* block = _nbt_alloc(tag, _nbt_long_array_size(length, order));
+	if (order != nbt_native_byte_order) {
+		*(int*)block = NBT_LONG_ARRAY_WIRE;
+		block += NBT_LONG_ARRAY_HEADER;
+	}
+	array->length = length;
+	array->order = order;
+	array->long_array = (int64_t*)block;
+	return array->long_array;
+}
+
+const void* nbt_long_array_raw(nbt_t* tag, nbt_byte_order_t* order) {
+	assert(tag);
+	assert(tag->type == NBT_LONG_ARRAY);
+	if (order) {
+		*order = tag->payload.tag_long_array.order;
+	}
+	return tag->payload.tag_long_array.long_array;
+}
+
+int32_t nbt_array_length(nbt_t* tag) {
+	assert(tag);
+	switch (tag->type) {
+		case NBT_BYTE_ARRAY:
+			return tag->payload.tag_byte_array.length;
+		case NBT_INT_ARRAY:
+			return tag->payload.tag_int_array.length;
+		case NBT_LONG_ARRAY:
+			return tag->payload.tag_long_array.length;
+		default:
+			assert(0);
+			return 0;
+	}
+}
+
 const char* nbt_string(nbt_t* tag) {
 	assert(tag);
 	assert(tag->type == NBT_STRING);
-	return tag->payload.tag_string;
+	struct nbt_string* string = &tag->payload.tag_string;
+	if (!(tag->flags & NBT_FLAG_BORROWED)) {
+		return string->string;
+	}
+	/* The input has no NUL after it, so the first reader makes a copy of its own and any others wait for it, like nbt_long_array */
+	uint8_t expected = NBT_STRING_BORROWED;
+	if (__atomic_load_n(&string->copy, __ATOMIC_ACQUIRE) != NBT_STRING_COPIED) {
+		if (__atomic_compare_exchange_n(&string->copy, &expected, NBT_STRING_COPYING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			/* Not from the arena itself, which only the thread building the tree can allocate from */
+			char* copy = _nbt_arena_block_create(string->length + 1);
+			memcpy(copy, string->string, string->length);
+			copy[string->length] = '\0';
+			_nbt_arena_attach(_nbt_arena_of(tag), copy);
+			__atomic_store_n(&string->string, copy, __ATOMIC_RELEASE);
+			__atomic_store_n(&string->copy, NBT_STRING_COPIED, __ATOMIC_RELEASE);
+		} else {
+			while (__atomic_load_n(&string->copy, __ATOMIC_ACQUIRE) != NBT_STRING_COPIED) {
+				sched_yield();
+			}
+		}
+	}
+	return _nbt_string_bytes(tag);
+}
+
+const char* nbt_string_view(nbt_t* tag, int32_t* length) {
+	assert(tag);
+	assert(tag->type == NBT_STRING);
+	*length = tag->payload.tag_string.length;
+	return _nbt_string_bytes(tag);
+}
+
+int32_t nbt_string_length(nbt_t* tag) {
+	assert(tag);
+	assert(tag->type == NBT_STRING);
+	return tag->payload.tag_string.length;
+}
+
+void nbt_copy_borrowed(nbt_t* tag) {
+	assert(tag);
+	_nbt_walk(tag, _nbt_copy_payload, NULL, NULL, NBT_WALK_DEFERRED);
+}
+
+/* Deferred nodes point into a source the tree keeps, they aren't borrowing anything */
+nbt_walk_action_t _nbt_copy_payload(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	if (!(tag->flags & NBT_FLAG_BORROWED)) {
+		return NBT_WALK_CONTINUE;
+	}
+	if (tag->type == NBT_STRING) {
+		struct nbt_string* string = &tag->payload.tag_string;
+		if (string->copy == NBT_STRING_COPIED) {
+			/* nbt_string already made one */
+			tag->flags &= ~NBT_FLAG_BORROWED;
+			return NBT_WALK_CONTINUE;
+		}
+		char* copy = _nbt_alloc(tag, string->length + 1);
+		memcpy(copy, string->string, string->length);
+		copy[string->length] = '\0';
+		string->string = copy;
+	} else {
+		struct nbt_byte_array* array = &tag->payload.tag_byte_array;
+		int8_t* copy = _nbt_alloc(tag, array->length);
+		memcpy(copy, array->byte_array, array->length);
+		array->byte_array = copy;
+	}
+	tag->flags &= ~NBT_FLAG_BORROWED;
+	return NBT_WALK_CONTINUE;
 }
 
 /* Working with lists */
 int32_t nbt_list_count(nbt_t* list) {
 	assert(list);
 	assert(list->type == NBT_LIST);
-	return _nbt_tree_count(list->payload.tag_list.tree);
+	return list->payload.tag_list.count;
 }
 
 int32_t _nbt_tree_count(nbt_t* node) {
-	if (node) {
-		return _nbt_tree_count(node->tree_right) + 1;
-	} else {
-		return 0;
+	int32_t count = 0;
+	for (; node; node = node->tree_right) {
+		count++;
 	}
+	return count;
 }
 
 nbt_t* nbt_list_index(nbt_t* list, int32_t index) {
 	assert(list);
 	assert(list->type == NBT_LIST);
-	return _nbt_tree_index(list->payload.tag_list.tree, index);
+	if (index < 0 || index >= list->payload.tag_list.count) {
+		return NULL;
+	}
+	if (list->flags & NBT_FLAG_PACKED) {
+		return _nbt_list_nodes(list)->items[index];
+	}
+	return _nbt_decoded(list->payload.tag_list.elements.items[index]);
 }
 
-nbt_t* _nbt_tree_index(nbt_t* node, int32_t index) {
-	if (node) {
-		if (index) {
-			return _nbt_tree_index(node->tree_right, index - 1);
+void nbt_list_add(nbt_t* list, nbt_t* item) {
+	assert(list);
+	assert(list->type == NBT_LIST);
+	assert(list->element_type == item->type);
+	struct nbt_list* elements = &list->payload.tag_list;
+	if (elements->count == elements->reserved) {
+		_nbt_list_reserve(list, elements->reserved ? elements->reserved * 2 : 4);
+	}
+	if (list->flags & NBT_FLAG_PACKED) {
+		/* Just the value, every primitive sits at the start of the payload */
+		size_t width = _nbt_packed_width(list->element_type);
+		memcpy((char*)elements->elements.values + width * elements->count++, &item->payload, width);
+		_nbt_list_changed(list);
+	}
+	if (list->flags & NBT_FLAG_ARENA && !(item->flags & NBT_FLAG_ARENA)) {
+		/* Releasing the arena has to find this one now */
+		_nbt_arena_mix(_nbt_arena_of(list));
+	}
+	if (list->flags & NBT_FLAG_PACKED) {
+		/* Still the list's to release, so the caller's pointer stays good for as long as it would have */
+		struct nbt_list_header* header = _nbt_list_header(list);
+		item->tree_right = header->added;
+		header->added = item;
+		return;
+	}
+	elements->elements.items[elements->count++] = item;
+}
+
+void _nbt_list_reserve(nbt_t* list, int32_t count) {
+	struct nbt_list* elements = &list->payload.tag_list;
+	if (count > elements->reserved) {
+		bool packed = list->flags & NBT_FLAG_PACKED;
+		size_t width = packed ? _nbt_packed_width(list->element_type) : sizeof(nbt_t*);
+		/* Packed values have the nodes nbt_list_index made in front of them */
+		size_t header = packed ? NBT_LIST_HEADER : 0;
+		char* old = elements->elements.values ? (char*)elements->elements.values - header : NULL;
+		char* values;
+		if (list->flags & NBT_FLAG_ARENA) {
+			/* Can't realloc out of an arena, the old array just stays behind */
+			values = _nbt_arena_alloc(_nbt_arena_of(list), header + width * count);
+			if (old) {
+				memcpy(values, old, header + width * elements->count);
+			}
+		} else {
+			values = realloc(old, header + width * count);
+			assert(values);
+		}
+		if (packed && !old) {
+			memset(values, 0, sizeof(struct nbt_list_header));
 		}
-		return node;
+		elements->elements.values = values + header;
+		elements->reserved = count;
 	}
-	return NULL;
 }
 
-void nbt_list_add(nbt_t* list, nbt_t* item) {
+void nbt_list_remove(nbt_t* list, int32_t index) {
 	assert(list);
 	assert(list->type == NBT_LIST);
-	assert(list->payload.tag_list.type == item->type);
-	if (list->payload.tag_list.tree) {
-		nbt_t* node = _nbt_tree_end(list->payload.tag_list.tree);
-		node->tree_right = item;
-		item->tree_left = node;
+	struct nbt_list* elements = &list->payload.tag_list;
+	assert(index >= 0 && index < elements->count);
+	size_t width = sizeof(nbt_t*);
+	if (list->flags & NBT_FLAG_PACKED) {
+		width = _nbt_packed_width(list->element_type);
 	} else {
-		list->payload.tag_list.tree = item;
+		nbt_release(elements->elements.items[index]);
+	}
+	char* values = elements->elements.values;
+	memmove(values + width * index, values + width * (index + 1), width * (elements->count - index - 1));
+	elements->count--;
+	if (list->flags & NBT_FLAG_PACKED) {
+		_nbt_list_changed(list);
 	}
 }
 
-nbt_t* _nbt_tree_end(nbt_t* node) {
-	if (node->tree_right) {
-		return _nbt_tree_end(node->tree_right);
+nbt_t* nbt_create_list_values(const char* name, nbt_type_t type, const void* values, int32_t count) {
+	assert(_nbt_packed_width(type));
+	nbt_t* tag = nbt_create_list(name, type);
+	if (count > 0) {
+		_nbt_list_reserve(tag, count);
+		memcpy(tag->payload.tag_list.elements.values, values, _nbt_packed_width(type) * count);
+		tag->payload.tag_list.count = count;
 	}
-	return node;
+	return tag;
 }
 
-void nbt_list_remove(nbt_t* list, int32_t index) {
+const int8_t* nbt_list_bytes(nbt_t* list) {
+	return _nbt_list_values(list, NBT_BYTE);
+}
+
+const int16_t* nbt_list_shorts(nbt_t* list) {
+	return _nbt_list_values(list, NBT_SHORT);
+}
+
+const int32_t* nbt_list_ints(nbt_t* list) {
+	return _nbt_list_values(list, NBT_INT);
+}
+
+const int64_t* nbt_list_longs(nbt_t* list) {
+	return _nbt_list_values(list, NBT_LONG);
+}
+
+const float* nbt_list_floats(nbt_t* list) {
+	return _nbt_list_values(list, NBT_FLOAT);
+}
+
+const double* nbt_list_doubles(nbt_t* list) {
+	return _nbt_list_values(list, NBT_DOUBLE);
+}
+
+void* _nbt_list_values(nbt_t* list, nbt_type_t type) {
 	assert(list);
 	assert(list->type == NBT_LIST);
-	nbt_t* node = _nbt_tree_index(list->payload.tag_list.tree, index);
-	assert(node);
-	_nbt_tree_remove(node);
+	assert(list->element_type == type);
+	assert(list->flags & NBT_FLAG_PACKED);
+	return list->payload.tag_list.elements.values;
+}
+
+/* Element sizes of the types that can be packed, 0 for the rest */
+size_t _nbt_packed_width(nbt_type_t type) {
+	switch (type) {
+		case NBT_BYTE:
+			return sizeof(int8_t);
+		case NBT_SHORT:
+			return sizeof(int16_t);
+		case NBT_INT:
+			return sizeof(int32_t);
+		case NBT_LONG:
+			return sizeof(int64_t);
+		case NBT_FLOAT:
+			return sizeof(float);
+		case NBT_DOUBLE:
+			return sizeof(double);
+		default:
+			return 0;
+	}
 }
 
-void _nbt_tree_remove(nbt_t* node) {
-	if (node) {
-		if (node->tree_left) {
-			node->tree_left->tree_right = node->tree_right;
-		}
-		if (node->tree_right) {
-			node->tree_right->tree_left = node->tree_left;
-		}
-		nbt_release(node);
+struct nbt_list_header* _nbt_list_header(nbt_t* list) {
+	return (struct nbt_list_header*)((char*)list->payload.tag_list.elements.values - NBT_LIST_HEADER);
+}
+
+/* Made the first time they're asked for, readers on other threads race to put theirs in and the loser drops its own */
+struct nbt_list_nodes* _nbt_list_nodes(nbt_t* list) {
+	struct nbt_list_nodes** slot = &_nbt_list_header(list)->nodes;
+	struct nbt_list_nodes* nodes = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (nodes && !nodes->stale) {
+		return nodes;
+	}
+	struct nbt_list* elements = &list->payload.tag_list;
+	size_t width = _nbt_packed_width(list->element_type);
+	struct nbt_list_nodes* made = _nbt_arena_block_create(sizeof(*made) + (sizeof(nbt_t*) + sizeof(nbt_t)) * elements->count);
+	made->older = nodes;
+	made->stale = false;
+	nbt_t* node = (nbt_t*)&made->items[elements->count];
+	for (int32_t i = 0; i < elements->count; i++, node++) {
+		memset(node, 0, sizeof(*node));
+		node->type = list->element_type;
+		memcpy(&node->payload, (const char*)elements->elements.values + width * i, width);
+		made->items[i] = node;
+	}
+	if (!__atomic_compare_exchange_n(slot, &nodes, made, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		_nbt_arena_block_release(made);
+		return nodes;
+	}
+	if (list->flags & NBT_FLAG_ARENA) {
+		/* Goes when the arena does, like the rest of the list */
+		_nbt_arena_attach(_nbt_arena_of(list), made);
+	}
+	return made;
+}
+
+/* Nodes already handed out stay where they are, the next nbt_list_index makes new ones */
+void _nbt_list_changed(nbt_t* list) {
+	struct nbt_list_nodes* nodes = _nbt_list_header(list)->nodes;
+	if (nodes) {
+		nodes->stale = true;
+	}
+}
+
+void _nbt_list_release_nodes(nbt_t* list) {
+	struct nbt_list_nodes* nodes = _nbt_list_header(list)->nodes;
+	while (nodes) {
+		struct nbt_list_nodes* older = nodes->older;
+		_nbt_arena_block_release(nodes);
+		nodes = older;
 	}
 }
 
+/* Only ever numbers, so there's nothing under them */
+void _nbt_list_release_added(nbt_t* list) {
+	nbt_t* item = _nbt_list_header(list)->added;
+	while (item) {
+		nbt_t* next = item->tree_right;
+		nbt_release(item);
+		item = next;
+	}
+}
+
+/* A packed element is filled into scratch, which is only good until the next call */
+nbt_t* _nbt_list_element(nbt_t* list, int32_t index, nbt_t* scratch) {
+	struct nbt_list* elements = &list->payload.tag_list;
+	if (!(list->flags & NBT_FLAG_PACKED)) {
+		return elements->elements.items[index];
+	}
+	size_t width = _nbt_packed_width(list->element_type);
+	memset(scratch, 0, sizeof(*scratch));
+	scratch->type = list->element_type;
+	memcpy(&scratch->payload, (const char*)elements->elements.values + width * index, width);
+	return scratch;
+}
+
 /* Working with compounds */
 nbt_t* nbt_compound_name(nbt_t* compound, const char* name) {
 	assert(compound);
 	assert(compound->type == NBT_COMPOUND);
-	return _nbt_tree_name(compound->payload.tag_compound, name);
-}
-
-nbt_t* _nbt_tree_name(nbt_t* node, const char* name) {
-	if (node) {
-		if (strcmp(node->name, name)) {
-			return _nbt_tree_name(node->tree_right, name);
-		}
-		return node;
+	if (!name) {
+		name = "";
 	}
-	return NULL;
+	return _nbt_decoded(_nbt_compound_find(compound, name, strlen(name)));
 }
 
 void nbt_compound_set(nbt_t* compound, nbt_t* item) {
 	assert(compound);
 	assert(compound->type == NBT_COMPOUND);
 	assert(item);
-	nbt_t* current = nbt_compound_name(compound, item->name);
+	struct nbt_compound* children = &compound->payload.tag_compound;
+	if (compound->flags & NBT_FLAG_ARENA && !(item->flags & NBT_FLAG_ARENA)) {
+		/* Releasing the arena has to find this one now */
+		_nbt_arena_mix(_nbt_arena_of(compound));
+	}
+	nbt_t* current = _nbt_compound_find(compound, _nbt_name_bytes(item), item->name_length);
 	if (current) {
-		_nbt_tree_replace(current, item);
+		/* Take over its place in the chain and the index */
+		item->tree_left = current->tree_left;
+		item->tree_right = current->tree_right;
+		if (current == children->head) {
+			children->head = item;
+		} else {
+			item->tree_left->tree_right = item;
+		}
+		if (item->tree_right) {
+			item->tree_right->tree_left = item;
+		} else {
+			children->head->tree_left = item;
+		}
+		if (children->index) {
+			*_nbt_index_slot(children->index, _nbt_name_bytes(item), item->name_length, _nbt_node_hash(item)) = item;
+		}
+		current->tree_left = current->tree_right = NULL;
+		nbt_release(current);
+		return;
+	}
+	_nbt_compound_append(compound, item);
+	if (children->index) {
+		_nbt_index_insert(compound, item);
+	}
+}
+
+void nbt_compound_remove(nbt_t* compound, const char* name) {
+	assert(compound);
+	assert(compound->type == NBT_COMPOUND);
+	if (!name) {
+		name = "";
+	}
+	nbt_t* node = _nbt_compound_find(compound, name, strlen(name));
+	if (node) {
+		_nbt_compound_unlink(compound, node);
+		nbt_release(node);
+	}
+}
+
+static inline bool _nbt_name_equal(nbt_t* node, const char* name, size_t length) {
+	/* Atoms and names out of the same buffer match without looking at the bytes */
+	const char* bytes = _nbt_name_bytes(node);
+	return node->name_length == length && (bytes == name || !memcmp(bytes, name, length));
+}
+
+nbt_t* _nbt_compound_find(nbt_t* compound, const char* name, size_t length) {
+	struct nbt_compound* children = &compound->payload.tag_compound;
+	if (children->index) {
+		return *_nbt_index_slot(children->index, name, length, _nbt_hash_bytes(name, length));
+	}
+	size_t walked = 0;
+	for (nbt_t* node = children->head; node; node = node->tree_right) {
+		if (walked++ == NBT_COMPOUND_INDEX_THRESHOLD) {
+			/* Long enough that it's worth hashing, every lookup after this is O(1) */
+			size_t count = walked;
+			for (nbt_t* rest = node; rest->tree_right; rest = rest->tree_right) {
+				count++;
+			}
+			_nbt_index_build(compound, count);
+			return *_nbt_index_slot(children->index, name, length, _nbt_hash_bytes(name, length));
+		}
+		if (_nbt_name_equal(node, name, length)) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+void _nbt_compound_append(nbt_t* compound, nbt_t* item) {
+	struct nbt_compound* children = &compound->payload.tag_compound;
+	item->tree_right = NULL;
+	if (children->head) {
+		nbt_t* tail = children->head->tree_left;
+		tail->tree_right = item;
+		item->tree_left = tail;
 	} else {
-		if (compound->payload.tag_compound) {
-			current = _nbt_tree_end(compound->payload.tag_compound);
-			current->tree_right = item;
-			item->tree_left = current;
+		children->head = item;
+	}
+	children->head->tree_left = item;
+}
+
+void _nbt_compound_unlink(nbt_t* compound, nbt_t* node) {
+	struct nbt_compound* children = &compound->payload.tag_compound;
+	if (children->index) {
+		_nbt_index_remove(children->index, node);
+	}
+	if (node == children->head) {
+		children->head = node->tree_right;
+		if (children->head) {
+			/* Hand the tail over */
+			children->head->tree_left = node->tree_left;
+		}
+	} else {
+		node->tree_left->tree_right = node->tree_right;
+		if (node->tree_right) {
+			node->tree_right->tree_left = node->tree_left;
 		} else {
-			compound->payload.tag_compound = item;
+			children->head->tree_left = node->tree_left;
 		}
 	}
+	node->tree_left = node->tree_right = NULL;
+}
+
+/* Atoms already know theirs */
+uint32_t _nbt_node_hash(nbt_t* node) {
+	if (node->flags & NBT_FLAG_ATOM) {
+		return _nbt_atom_of(node->name.pointer)->hash;
+	}
+	return _nbt_hash_bytes(_nbt_name_bytes(node), node->name_length);
 }
 
-void _nbt_tree_replace(nbt_t* current, nbt_t* replacement) {
-	if (current->tree_left) {
-		current->tree_left->tree_right = replacement;
+void _nbt_index_build(nbt_t* compound, size_t count) {
+	struct nbt_compound* children = &compound->payload.tag_compound;
+	/* Keep it under half full so probes stay short */
+	size_t capacity = 32;
+	while (capacity < count * 2) {
+		capacity <<= 1;
 	}
-	if (current->tree_right) {
-		current->tree_right->tree_left = replacement;
+	_nbt_free(compound, children->index);
+	children->index = _nbt_alloc(compound, sizeof(*children->index) + sizeof(nbt_t*) * capacity);
+	memset(children->index->slots, 0, sizeof(nbt_t*) * capacity);
+	children->index->count = 0;
+	children->index->mask = capacity - 1;
+	for (nbt_t* node = children->head; node; node = node->tree_right) {
+		nbt_t** slot = _nbt_index_slot(children->index, _nbt_name_bytes(node), node->name_length, _nbt_node_hash(node));
+		/* With duplicate names (hand built trees) the first one wins, like the walk */
+		if (!*slot) {
+			*slot = node;
+			children->index->count++;
+		}
 	}
-	nbt_release(current);
 }
 
-void nbt_compound_remove(nbt_t* compound, const char* name) {
-	assert(compound);
-	assert(compound->type == NBT_COMPOUND);
-	_nbt_tree_remove(nbt_compound_name(compound, name));
+/* The slot holding name, or the empty slot it would go in */
+nbt_t** _nbt_index_slot(struct nbt_compound_index* index, const char* name, size_t length, uint32_t hash) {
+	size_t i = hash & index->mask;
+	while (index->slots[i] && !_nbt_name_equal(index->slots[i], name, length)) {
+		i = (i + 1) & index->mask;
+	}
+	return &index->slots[i];
+}
+
+void _nbt_index_insert(nbt_t* compound, nbt_t* node) {
+	struct nbt_compound_index* index = compound->payload.tag_compound.index;
+	if ((index->count + 1) * 4 > (index->mask + 1) * 3) {
+		/* The chain already has the node, so rebuilding picks it up */
+		_nbt_index_build(compound, index->count + 1);
+		return;
+	}
+	nbt_t** slot = _nbt_index_slot(index, _nbt_name_bytes(node), node->name_length, _nbt_node_hash(node));
+	if (!*slot) {
+		*slot = node;
+		index->count++;
+	}
+}
+
+void _nbt_index_remove(struct nbt_compound_index* index, nbt_t* node) {
+	nbt_t** slot = _nbt_index_slot(index, _nbt_name_bytes(node), node->name_length, _nbt_node_hash(node));
+	if (*slot != node) {
+		return;
+	}
+	/* Backward shift deletion, so there are no tombstones to skip */
+	size_t hole = slot - index->slots;
+	size_t i = hole;
+	for (;;) {
+		i = (i + 1) & index->mask;
+		if (!index->slots[i]) {
+			break;
+		}
+		size_t home = _nbt_node_hash(index->slots[i]) & index->mask;
+		/* Move it back if its home isn't cyclically within (hole, i] */
+		if (((i - home) & index->mask) >= ((i - hole) & index->mask)) {
+			index->slots[hole] = index->slots[i];
+			hole = i;
+		}
+	}
+	index->slots[hole] = NULL;
+	index->count--;
 }
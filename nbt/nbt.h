@@ -45,7 +45,9 @@ typedef enum {
 	NBT_ERROR_UNKNOWN	= 1,
 	NBT_ERROR_MEMORY	= 2,
 	NBT_ERROR_IO		= 3,
-	NBT_ERROR_ZLIB		= 4
+	NBT_ERROR_ZLIB		= 4,
+	NBT_ERROR_FORMAT	= 5,	/* the input ends early or isn't NBT */
+	NBT_ERROR_LIMIT		= 6		/* the input is deeper or bigger than the limits allow */
 } nbt_status_t;
 
 typedef enum {
@@ -60,7 +62,8 @@ typedef enum {
 	NBT_STRING		= 8,
 	NBT_LIST		= 9,
 	NBT_COMPOUND	= 10,
-	NBT_INT_ARRAY	= 11
+	NBT_INT_ARRAY	= 11,
+	NBT_LONG_ARRAY	= 12
 } nbt_type_t;
 
 /* Create a node */
@@ -79,6 +82,7 @@ nbt_t* nbt_create_string(const char* name, const char* payload);
 /* Create array types */
 nbt_t* nbt_create_byte_array(const char* name, const int8_t* bytes, int32_t length);
 nbt_t* nbt_create_int_array(const char* name, const int32_t* ints, int32_t length);
+nbt_t* nbt_create_long_array(const char* name, const int64_t* longs, int32_t length);
 
 /* Create list node. */
 nbt_t* nbt_create_list(const char* name, nbt_type_t type);
@@ -93,9 +97,167 @@ void nbt_release(nbt_t* tag);
 nbt_t* nbt_parse_data(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp);
 nbt_t* nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp);
 
+typedef enum {
+	/*
+	 * Allocate every node, name and payload out of a few big slabs that belong
+	 * to the root, so releasing the root is a handful of frees. The tree can
+	 * still be changed: replaced and removed nodes just stay in the slabs until
+	 * the root goes. Nodes from an arena tree must not outlive its root, so
+	 * don't move them into another tree. A slab is 64K, so small payloads
+	 * are quicker without it.
+	 */
+	NBT_PARSE_ARENA		= 1 << 0,
+	/*
+	 * Point names at shared atoms (see nbt_intern) instead of giving every
+	 * node its own copy. Names under 8 bytes are kept in the node either
+	 * way, and ones over 64 bytes still get a copy.
+	 */
+	NBT_PARSE_INTERN	= 1 << 1,
+	/*
+	 * Decode only what's looked at. The parse keeps its own copy of the
+	 * uncompressed input and just notes where each of the root's children
+	 * is; strings, arrays, lists and compounds are decoded the first time
+	 * nbt_compound_name, nbt_list_index or nbt_walk hands them out, and
+	 * their children are put off the same way. Writing copies anything
+	 * nobody looked at straight from the input when the byte order is the
+	 * same. The copy goes once nothing is left pointing into it. Reading a
+	 * lazy tree changes it, so even reads can't share it between threads.
+	 */
+	NBT_PARSE_LAZY		= 1 << 2,
+	/*
+	 * Point strings and byte arrays into the input instead of giving each
+	 * one its own copy. Uncompressed input that's all in memory is used as
+	 * it is, so it has to stay put and unchanged until the root is released
+	 * or has been through nbt_copy_borrowed. Otherwise the parse keeps the
+	 * uncompressed input itself, taking a context's inflate buffer rather
+	 * than copying it. This implies NBT_PARSE_ARENA and its rules. A
+	 * borrowed string isn't NUL terminated: nbt_string_view hands it back
+	 * as it is, and nbt_string copies it the first time it's called, which
+	 * is safe from several threads at once like the rest of the reads.
+	 */
+	NBT_PARSE_BORROW	= 1 << 3,
+	/*
+	 * Decode big inputs on more than one thread. A quick pass over the
+	 * length prefixes finds where each of the root's children starts, and
+	 * each element of any big list or compound among them, and runs of
+	 * those are decoded on their own threads and put back together in
+	 * order, so the tree is the same as a plain parse's. Input that's
+	 * streamed in is read to the end first. Small inputs, lazy parses and
+	 * projections are parsed as usual.
+	 */
+	NBT_PARSE_PARALLEL	= 1 << 4
+} nbt_parse_flags_t;
+
+/*
+ * Parsing only part of a tree. A projection is a set of dotted paths down
+ * from the root's children, like "Data.Player.Inventory" or "Level.xPos".
+ * A parse with one builds the compounds along each path and everything
+ * under the tag a path ends at, and moves past the rest by its length
+ * prefixes without making any nodes for it. A list along a path hands the
+ * rest of the path to each of its elements, so "Entities.id" keeps every
+ * entity's id. Elements stay even when nothing under them matched, left
+ * empty, so indices are the same as in the full tree. Lists that can't lead
+ * anywhere are left out, as are compounds and lists other than the root with
+ * nothing under them on a path. Names with dots in them can't be
+ * projected. A projection is read only once it's made, so any number of
+ * parses on any number of threads can share it.
+ */
+typedef struct nbt_projection nbt_projection_t;
+
+nbt_projection_t* nbt_projection_create(const char* const* paths, size_t count);
+void nbt_projection_release(nbt_projection_t* projection);
+
+/*
+ * Caps on untrusted input, 0 leaves one off. A parse with limits checks the
+ * uncompressed input with nbt_validate before it builds anything, so bad
+ * input comes back as NBT_ERROR_FORMAT instead of asserting, and counts what
+ * it allocates as it goes. Compressed input is inflated in one go first and
+ * corrupt data comes back as NBT_ERROR_ZLIB; input that's streamed in
+ * (from an fd, say) is read to the end first, up to the inflated limit.
+ * A parse past a limit returns NULL with NBT_ERROR_LIMIT. Lazy parses only
+ * get the checks up front.
+ */
+typedef struct {
+	size_t depth;	/* compounds and lists open at once, a compound root is 1 */
+	size_t tags;	/* in the whole input, the root and every list element included */
+	size_t bytes;	/* allocated for the tree: nodes, long names and payloads */
+	size_t inflated;	/* uncompressed input */
+} nbt_limits_t;
+
+typedef struct {
+	nbt_parse_flags_t flags;
+	const nbt_projection_t* projection;	/* NULL for all of it, lazy parses don't look at it */
+	const nbt_limits_t* limits;	/* NULL for none */
+	size_t threads;	/* for NBT_PARSE_PARALLEL, 0 for one per CPU */
+} nbt_parse_options_t;
+
+/* A NULL options is the same as the defaults the plain versions use */
+nbt_t* nbt_parse_data_options(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, const nbt_parse_options_t* options, nbt_status_t* errorp);
+nbt_t* nbt_parse_coder_options(nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, const nbt_parse_options_t* options, nbt_status_t* errorp);
+
+/*
+ * Checking that uncompressed input is well formed before committing to a
+ * parse: type bytes, lengths, bounds and the limits (NULL for none), in one
+ * pass with no allocation (short of nesting deeper than 512). Returns
+ * NBT_ERROR_FORMAT or NBT_ERROR_LIMIT with *offset at the byte the problem
+ * is at (NBT_ERROR_MEMORY if nesting that deep can't be kept track of), or
+ * NBT_SUCCESS with *offset just past the root; offset can be NULL.
+ */
+nbt_status_t nbt_validate(const char* bytes, size_t length, nbt_byte_order_t order, const nbt_limits_t* limits, size_t* offset);
+
 /* Writing */
+typedef enum {
+	NBT_WRITE_ATOMIC	= 1 << 0,	/* write a temporary file and rename it over the path */
+	NBT_WRITE_GZIP		= 1 << 1,	/* compress like a level.dat */
+	NBT_WRITE_ZLIB		= 1 << 2	/* compress like a chunk */
+} nbt_write_flags_t;
+
 nbt_coder_t* nbt_write_data(nbt_t* tag, nbt_byte_order_t order);
 
+/* Deflated as it's serialized, the uncompressed form never exists in memory */
+nbt_coder_t* nbt_write_compressed(nbt_t* tag, nbt_byte_order_t order, nbt_compression_strategy_t compression_strategy);
+
+/*
+ * These serialize through a sink, so the file is written as the tree is walked
+ * (on a writer thread, overlapping with the walk) and the output is never held
+ * in memory. An atomic write leaves the old file
+ * in place until the new one is completely written and synced; the new file
+ * takes the old one's permissions (0644 if there wasn't one). nbt_write_coder
+ * finishes the coder once the tag is written.
+ */
+nbt_status_t nbt_write_coder(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order);
+nbt_status_t nbt_write_fd(nbt_t* tag, int fd, nbt_byte_order_t order, nbt_write_flags_t flags);
+nbt_status_t nbt_write_file(nbt_t* tag, const char* path, nbt_byte_order_t order, nbt_write_flags_t flags);
+
+/*
+ * A context keeps the buffers, zlib streams and scratch space that parsing,
+ * writing and compression need between calls, so a thread working through
+ * lots of small payloads stops allocating once it's warmed up. Use one per
+ * thread. The coders they return belong to the context: don't release them,
+ * and each is only good until the next call that returns the same kind.
+ */
+typedef struct _nbt_context nbt_context_t;
+
+nbt_context_t* nbt_context_create();
+void nbt_context_release(nbt_context_t* context);
+
+/* Options for every parse made through the context from now on */
+void nbt_context_set_options(nbt_context_t* context, const nbt_parse_options_t* options);
+
+nbt_t* nbt_context_parse(nbt_context_t* context, const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp);
+nbt_t* nbt_context_parse_coder(nbt_context_t* context, nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp);
+nbt_coder_t* nbt_context_write(nbt_context_t* context, nbt_t* tag, nbt_byte_order_t order);
+nbt_coder_t* nbt_context_write_compressed(nbt_context_t* context, nbt_t* tag, nbt_byte_order_t order, nbt_compression_strategy_t compression_strategy);
+nbt_coder_t* nbt_context_compress(nbt_context_t* context, nbt_coder_t* coder, nbt_compression_strategy_t compression_strategy);
+nbt_coder_t* nbt_context_decompress(nbt_context_t* context, nbt_coder_t* coder);
+
+/*
+ * nbt_coder_decompress for input that might be a zip bomb or corrupt: stops
+ * once the output passes limit bytes (0 for no limit) and returns NULL with
+ * NBT_ERROR_LIMIT, or NBT_ERROR_ZLIB for bad data, instead of asserting.
+ */
+nbt_coder_t* nbt_coder_decompress_limit(nbt_coder_t* coder, size_t limit, nbt_status_t* errorp);
+
 /* Get the value of simple types */
 int8_t nbt_byte(nbt_t* tag);
 int16_t nbt_short(nbt_t* tag);
@@ -106,20 +268,200 @@ double nbt_double(nbt_t* tag);
 
 const int8_t* nbt_byte_array(nbt_t* tag);
 const int32_t* nbt_int_array(nbt_t* tag);
+const int64_t* nbt_long_array(nbt_t* tag);
+int32_t nbt_array_length(nbt_t* tag);
+
+/*
+ * Long arrays are parsed as the raw bytes off the wire, and the first call
+ * to nbt_long_array makes a native copy beside them if the orders differ.
+ * This hands back the wire bytes as they were parsed, with their byte order
+ * in *order, and never changes. Any number of threads can call either at once.
+ */
+const void* nbt_long_array_raw(nbt_t* tag, nbt_byte_order_t* order);
 
 const char* nbt_string(nbt_t* tag);
 
+/* In bytes, parsed strings can have NULs in them */
+int32_t nbt_string_length(nbt_t* tag);
+
+/* The string's bytes without copying it, only NUL terminated if nbt_string has been called */
+const char* nbt_string_view(nbt_t* tag, int32_t* length);
+
+/* Copy whatever under tag is still borrowed from the input (see NBT_PARSE_BORROW), so the input can go */
+void nbt_copy_borrowed(nbt_t* tag);
+
 /* Working with lists */
 int32_t nbt_list_count(nbt_t* list);
 nbt_t* nbt_list_index(nbt_t* list, int32_t index);
 void nbt_list_add(nbt_t* list, nbt_t* item);
 void nbt_list_remove(nbt_t* list, int32_t index);
 
+/*
+ * Lists of bytes, shorts, ints, longs, floats and doubles are always packed
+ * into a flat array of values instead of a node per element, and the typed
+ * accessors hand back that array. nbt_list_index on such a list makes the
+ * element nodes once and keeps them until the list is released, so reading
+ * from several threads is safe and the nodes stay valid, but they're copies:
+ * changing one doesn't change the list, and after nbt_list_add or
+ * nbt_list_remove they show what the list held before. nbt_list_add copies
+ * the item's value in, and the list still owns the item and keeps it until
+ * it's released, though changing it no longer changes the list. `values`
+ * holds count elements of type's C type.
+ */
+nbt_t* nbt_create_list_values(const char* name, nbt_type_t type, const void* values, int32_t count);
+const int8_t* nbt_list_bytes(nbt_t* list);
+const int16_t* nbt_list_shorts(nbt_t* list);
+const int32_t* nbt_list_ints(nbt_t* list);
+const int64_t* nbt_list_longs(nbt_t* list);
+const float* nbt_list_floats(nbt_t* list);
+const double* nbt_list_doubles(nbt_t* list);
+
 /* Working with compounds */
 nbt_t* nbt_compound_name(nbt_t* compound, const char* name);
 void nbt_compound_set(nbt_t* compound, nbt_t* item);
 void nbt_compound_remove(nbt_t* compound, const char* name);
 
+/*
+ * The process-wide copy of name, which lives until exit. Lookups with an atom
+ * in trees parsed with NBT_PARSE_INTERN match by pointer. Returns NULL for
+ * long names, which are never interned.
+ */
+const char* nbt_intern(const char* name);
+
+/*
+ * Walking a tree without recursing, so deep or long trees can't run out of
+ * stack. pre sees every tag before its children and post after them (right
+ * after pre for anything without children); either can be NULL. Returning
+ * NBT_WALK_SKIP from pre leaves out the tag's children, but post still sees
+ * the tag. Elements of packed lists are handed over in a temporary tag that's
+ * only good during the call. nbt_walk returns false if a visitor stopped it,
+ * or if there wasn't the memory to go any deeper.
+ */
+typedef enum {
+	NBT_WALK_CONTINUE	= 0,
+	NBT_WALK_SKIP		= 1,
+	NBT_WALK_STOP		= 2
+} nbt_walk_action_t;
+
+typedef struct {
+	nbt_t* parent;	/* NULL for the tag the walk started at */
+	int32_t index;	/* among the parent's children */
+	bool last;		/* the parent's last child */
+	size_t depth;	/* 0 for the tag the walk started at */
+} nbt_walk_position_t;
+
+typedef nbt_walk_action_t (*nbt_visitor_t)(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+
+bool nbt_walk(nbt_t* tag, nbt_visitor_t pre, nbt_visitor_t post, void* context);
+
+/*
+ * Parsing without building a tree. The handler sees each tag in order as an
+ * event: a container as a begin and an end with its children in between,
+ * anything else as one event. Nothing is allocated per tag. Names, strings
+ * and arrays point straight into the uncompressed input (the context's
+ * buffer if it had to be inflated), aren't NUL terminated, and array
+ * elements are still in the input's byte order. Returning NBT_WALK_SKIP
+ * from a begin moves past the container's children, though its end still
+ * comes, and NBT_WALK_STOP ends the parse there. Input that's cut short or
+ * isn't NBT ends the parse with NBT_ERROR_FORMAT, after the events for
+ * whatever came before it.
+ */
+typedef enum {
+	NBT_EVENT_BEGIN_COMPOUND,
+	NBT_EVENT_END_COMPOUND,
+	NBT_EVENT_BEGIN_LIST,
+	NBT_EVENT_END_LIST,
+	NBT_EVENT_SCALAR,	/* bytes through doubles, in the field named after the type */
+	NBT_EVENT_STRING,
+	NBT_EVENT_ARRAY		/* byte, int and long arrays */
+} nbt_event_kind_t;
+
+typedef struct {
+	nbt_event_kind_t kind;
+	nbt_type_t type;
+	const char* name;	/* NULL for list elements */
+	uint16_t name_length;
+	int32_t index;	/* among the list's elements, 0 in compounds */
+	size_t depth;	/* 0 for the root */
+	union {
+		int8_t tag_byte;
+		int16_t tag_short;
+		int32_t tag_int;
+		int64_t tag_long;
+		float tag_float;
+		double tag_double;
+		struct {
+			const char* bytes;
+			uint16_t length;
+		} string;
+		struct {
+			const void* elements;
+			int32_t length;
+			nbt_byte_order_t order;
+		} array;
+		struct {
+			nbt_type_t element_type;
+			int32_t count;
+		} list;	/* both of a list's events */
+	} value;
+} nbt_event_t;
+
+typedef nbt_walk_action_t (*nbt_event_handler_t)(const nbt_event_t* event, void* context);
+
+nbt_status_t nbt_parse_events(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_event_handler_t handler, void* context);
+nbt_status_t nbt_context_parse_events(nbt_context_t* context, const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_event_handler_t handler, void* handler_context);
+
+/*
+ * Pulling tags out of a coder one at a time, for code that steers the parse
+ * itself. nbt_reader_next moves to the next tag in the innermost open
+ * container (the root, before anything's open), skipping whatever's left
+ * of the last one, and returns false when there are no more. The current
+ * tag's payload can then be read with the call for its type, skipped
+ * without being decoded, or entered if it's a compound or list. Leaving
+ * skips the rest of the innermost container and closes it.
+ *
+ * Input that ends early or has a bad type or length doesn't assert: the
+ * call returns false, and so does every call after it, with the reason in
+ * nbt_reader_status. Reading a payload as the wrong type is still a bug.
+ * Names and views are only good until the next call. A reader allocates
+ * only to grow its stack and name buffer, so reset it to reuse it.
+ */
+typedef struct nbt_reader nbt_reader_t;
+
+typedef struct {
+	nbt_type_t type;
+	const char* name;	/* NULL for list elements */
+	uint16_t name_length;
+	int32_t index;	/* among the list's elements, 0 in compounds */
+	size_t depth;	/* 0 for the root */
+} nbt_reader_tag_t;
+
+nbt_reader_t* nbt_reader_create(nbt_coder_t* coder, nbt_byte_order_t order);
+void nbt_reader_reset(nbt_reader_t* reader, nbt_coder_t* coder, nbt_byte_order_t order);
+void nbt_reader_release(nbt_reader_t* reader);
+nbt_status_t nbt_reader_status(nbt_reader_t* reader);
+
+bool nbt_reader_next(nbt_reader_t* reader, nbt_reader_tag_t* tag);
+bool nbt_reader_skip(nbt_reader_t* reader);
+
+/* element_type and count can be NULL, and are only set for lists */
+bool nbt_reader_enter(nbt_reader_t* reader, nbt_type_t* element_type, int32_t* count);
+bool nbt_reader_leave(nbt_reader_t* reader);
+
+bool nbt_reader_read_byte(nbt_reader_t* reader, int8_t* value);
+bool nbt_reader_read_short(nbt_reader_t* reader, int16_t* value);
+bool nbt_reader_read_int(nbt_reader_t* reader, int32_t* value);
+bool nbt_reader_read_long(nbt_reader_t* reader, int64_t* value);
+bool nbt_reader_read_float(nbt_reader_t* reader, float* value);
+bool nbt_reader_read_double(nbt_reader_t* reader, double* value);
+bool nbt_reader_read_string_view(nbt_reader_t* reader, const char** bytes, uint16_t* length);
+
+/*
+ * Any of the array types, into elements in native byte order. *length is
+ * the array's full length; past capacity the elements are skipped.
+ */
+bool nbt_reader_read_array(nbt_reader_t* reader, void* elements, int32_t capacity, int32_t* length);
+
 /* Printing */
 typedef enum {
 	NBT_STYLE_ORIGINAL,
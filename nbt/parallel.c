@@ -0,0 +1,90 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  parallel.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "parallel.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+	size_t count;
+	size_t next;
+	nbt_parallel_job_t job;
+	void* context;
+} nbt_parallel_work_t;
+
+void* _nbt_parallel_worker(void* argument);
+
+void _nbt_parallel_for(size_t count, size_t threads, nbt_parallel_job_t job, void* context) {
+	if (!threads) {
+		threads = _nbt_parallel_threads();
+	}
+	if (threads > count) {
+		threads = count;
+	}
+	nbt_parallel_work_t work = {
+		.count		= count,
+		.next		= 0,
+		.job		= job,
+		.context	= context
+	};
+	
+	/* The calling thread works too, so it only has to spawn the rest */
+	pthread_t* workers = malloc(sizeof(*workers) * threads);
+	size_t spawned = 0;
+	for (size_t i = 1; i < threads; i++) {
+		if (pthread_create(&workers[spawned], NULL, _nbt_parallel_worker, &work)) {
+			/* Carry on with the ones we've got */
+			break;
+		}
+		spawned++;
+	}
+	_nbt_parallel_worker(&work);
+	for (size_t i = 0; i < spawned; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+}
+
+size_t _nbt_parallel_threads() {
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	return online > 0 ? online : 1;
+}
+
+void* _nbt_parallel_worker(void* argument) {
+	nbt_parallel_work_t* work = argument;
+	size_t index;
+	while ((index = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->count) {
+		work->job(work->context, index);
+	}
+	return NULL;
+}
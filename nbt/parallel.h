@@ -0,0 +1,47 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  parallel.h
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef parallel_h
+#define parallel_h
+
+#include <stddef.h>
+
+/*
+ * Run job(context, index) for every index below count, spread over up to
+ * `threads` threads (0 means one per online CPU), and wait for all of them.
+ * Indices are handed out in order, one at a time, so uneven jobs balance out.
+ */
+typedef void (*nbt_parallel_job_t)(void* context, size_t index);
+void _nbt_parallel_for(size_t count, size_t threads, nbt_parallel_job_t job, void* context);
+
+/* How many threads 0 means */
+size_t _nbt_parallel_threads();
+
+#endif /* parallel_h */
@@ -30,90 +30,507 @@
 #include "internal.h"
 #include "coder.h"
 
-nbt_t* _nbt_parse_payload(nbt_type_t type, const char* name, nbt_coder_t* coder, nbt_byte_order_t order, nbt_status_t* errorp);
-nbt_t* _nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, nbt_status_t* errorp);
+/* How many elements a list being streamed in gets room for before it has to grow */
+#define NBT_PARSE_STREAM_RESERVE 1024
+
+/* Deeper trees move their stack of open containers to the heap */
+#define NBT_PARSE_INLINE_DEPTH 32
+
+/* A container whose children are still being parsed */
+struct nbt_parse_frame {
+	nbt_t* tag;
+	int32_t remaining;	/* list elements still to come */
+};
+
+nbt_t* _nbt_parse_root(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, nbt_status_t* errorp);
+nbt_t* _nbt_parse_arena(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+bool _nbt_parse_value(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, int32_t* remaining);
+void _nbt_parse_packed(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, size_t width, int32_t count);
+bool _nbt_parse_deferred(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+const char* _nbt_parse_borrow(nbt_t* tag, nbt_coder_t* coder, size_t length);
 
 nbt_t* nbt_parse_data(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp) {
-	nbt_coder_t* coder = nbt_coder_create_data(bytes, length);
-	nbt_t* tag = nbt_parse_coder(coder, order, compressed, errorp);
+	return nbt_parse_data_options(bytes, length, order, compressed, NULL, errorp);
+}
+
+nbt_t* nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp) {
+	return nbt_parse_coder_options(coder, order, compressed, NULL, errorp);
+}
+
+nbt_t* nbt_parse_data_options(const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, const nbt_parse_options_t* options, nbt_status_t* errorp) {
+	nbt_coder_t* coder = nbt_coder_create_borrowed(bytes, length);
+	nbt_t* tag = nbt_parse_coder_options(coder, order, compressed, options, errorp);
 	nbt_coder_release(coder);
 	return tag;
 }
 
-nbt_t* nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp) {
+nbt_t* nbt_parse_coder_options(nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, const nbt_parse_options_t* options, nbt_status_t* errorp) {
+	/* Just for the scratch space, it lives as long as this parse */
+	nbt_context_t context;
+	_nbt_context_init(&context);
+	nbt_context_set_options(&context, options);
+	nbt_t* tag;
+	if (compressed && context.options.limits && _nbt_coder_whole(coder)) {
+		/* In one go, so a zip bomb or bad data comes back as a status */
+		tag = nbt_context_parse_coder(&context, coder, order, compressed, errorp);
+	} else if (compressed) {
+		/* Inflate as the parser asks for bytes instead of up front */
+		nbt_coder_t* inflate_coder = nbt_coder_create_inflate(coder);
+		tag = _nbt_parse_root(inflate_coder, order, &context, errorp);
+		nbt_coder_release(inflate_coder);
+	} else {
+		tag = _nbt_parse_root(coder, order, &context, errorp);
+	}
+	_nbt_context_clear(&context);
+	return tag;
+}
+
+nbt_t* nbt_context_parse(nbt_context_t* context, const char* bytes, size_t length, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp) {
+	if (context->view) {
+		_nbt_coder_view(context->view, bytes, length);
+	} else {
+		context->view = nbt_coder_create_borrowed(bytes, length);
+	}
+	return nbt_context_parse_coder(context, context->view, order, compressed, errorp);
+}
+
+nbt_t* nbt_context_parse_coder(nbt_context_t* context, nbt_coder_t* coder, nbt_byte_order_t order, bool compressed, nbt_status_t* errorp) {
 	if (compressed) {
-		coder = nbt_coder_decompress(coder);
+		/* Small payloads inflate fastest in one go into the context's buffer */
+		const nbt_limits_t* limits = context->options.limits;
+		nbt_status_t status = _nbt_context_decompress(context, coder, limits ? limits->inflated : 0);
+		if (status) {
+			if (errorp) {
+				*errorp = status;
+			}
+			return NULL;
+		}
+		coder = context->inflated;
+	}
+	return _nbt_parse_root(coder, order, context, errorp);
+}
+
+/* Input with limits on it is checked over before the parse and counted during it */
+nbt_t* _nbt_parse_root(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, nbt_status_t* errorp) {
+	const nbt_limits_t* limits = context->options.limits;
+	nbt_t* tag = NULL;
+	if (!limits) {
+		/* Nothing to check, though running out of memory still stops it */
+		tag = _nbt_parse_arena(coder, order, context);
+	} else {
+		if (!_nbt_coder_whole(coder)) {
+			/* Validating needs all of it at once, or as much as the limit lets in */
+			if (context->inflated) {
+				nbt_coder_reset(context->inflated);
+			} else {
+				context->inflated = nbt_coder_create();
+			}
+			if (!_nbt_coder_drain_into(coder, context->inflated, limits->inflated)) {
+				context->status = NBT_ERROR_LIMIT;
+			}
+			coder = context->inflated;
+		}
+		if (!context->status) {
+			size_t offset = _nbt_coder_tell(coder);
+			context->status = nbt_validate(nbt_coder_data(coder) + offset, nbt_coder_size(coder) - offset, order, limits, NULL);
+		}
+		if (!context->status) {
+			context->budget = limits->bytes ? limits->bytes : SIZE_MAX;
+			tag = _nbt_parse_arena(coder, order, context);
+			context->budget = SIZE_MAX;
+		}
+	}
+	if (context->status) {
+		nbt_release(tag);
+		tag = NULL;
+		if (errorp) {
+			*errorp = context->status;
+		}
+		context->status = NBT_SUCCESS;
 	}
-	return _nbt_parse_coder(coder, order, errorp);
+	return tag;
 }
 
-nbt_t* _nbt_parse_payload(nbt_type_t type, const char* name, nbt_coder_t* coder, nbt_byte_order_t order, nbt_status_t* errorp) {
-	switch (type) {
+/* Sets up the arena the whole tree comes out of, if the options ask for one */
+nbt_t* _nbt_parse_arena(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	if (context->options.flags & NBT_PARSE_LAZY) {
+		/* Sets up its own arena, the tree has to outlive this parse's context */
+		return _nbt_parse_lazy(coder, order, context);
+	}
+	if (context->options.flags & NBT_PARSE_BORROW && (!_nbt_coder_whole(coder) || coder == context->inflated)) {
+		/* Nothing the tree could point into outlasts the parse, so it keeps its own copy */
+		return _nbt_parse_borrowed(coder, order, context);
+	}
+	if (!(context->options.flags & NBT_PARSE_ARENA)) {
+		return _nbt_parse_tree(coder, order, context);
+	}
+	context->arena = _nbt_arena_create();
+	nbt_t* tag = _nbt_parse_tree(coder, order, context);
+	if (tag) {
+		tag->flags |= NBT_FLAG_ARENA_ROOT;
+	} else {
+		_nbt_arena_release(context->arena);
+	}
+	context->arena = NULL;
+	return tag;
+}
+
+/* The whole tree, or just the parts a projection asks for */
+nbt_t* _nbt_parse_tree(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	if (context->options.projection) {
+		return _nbt_parse_projected_root(coder, order, context);
+	}
+	if (context->options.flags & NBT_PARSE_PARALLEL) {
+		return _nbt_parse_split(coder, order, context);
+	}
+	return _nbt_parse_coder(coder, order, context);
+}
+
+/* A payload up to its children, true if it has some still to come (remaining says how many for a list) */
+bool _nbt_parse_value(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, int32_t* remaining) {
+	switch (tag->type) {
 		case NBT_END:
-			return NULL;
+			break;
 		case NBT_BYTE:
-			return nbt_create_byte(name, nbt_coder_decode_byte(coder));
+			tag->payload.tag_byte = nbt_coder_decode_byte(coder);
+			break;
 		case NBT_SHORT:
-			return nbt_create_short(name, nbt_coder_decode_short(coder, order));
+			tag->payload.tag_short = nbt_coder_decode_short(coder, order);
+			break;
 		case NBT_INT:
-			return nbt_create_int(name, nbt_coder_decode_int(coder, order));
+			tag->payload.tag_int = nbt_coder_decode_int(coder, order);
+			break;
 		case NBT_LONG:
-			return nbt_create_long(name, nbt_coder_decode_long(coder, order));
+			tag->payload.tag_long = nbt_coder_decode_long(coder, order);
+			break;
 		case NBT_FLOAT:
-			return nbt_create_float(name, nbt_coder_decode_float(coder, order));
+			tag->payload.tag_float = nbt_coder_decode_float(coder, order);
+			break;
 		case NBT_DOUBLE:
-			return nbt_create_double(name, nbt_coder_decode_double(coder, order));
+			tag->payload.tag_double = nbt_coder_decode_double(coder, order);
+			break;
 		case NBT_BYTE_ARRAY: {
 			int32_t length = nbt_coder_decode_int(coder, order);
-			int8_t array[length];
-			nbt_coder_decode_data(coder, (char*)array, length);
-			return nbt_create_byte_array(name, array, length);
+			assert(length >= 0);
+			if (context->options.flags & NBT_PARSE_BORROW) {
+				tag->payload.tag_byte_array.length = length;
+				tag->payload.tag_byte_array.byte_array = (int8_t*)_nbt_parse_borrow(tag, coder, length);
+				break;
+			}
+			if (!_nbt_parse_spend(context, length)) {
+				break;
+			}
+			tag->payload.tag_byte_array.length = length;
+			tag->payload.tag_byte_array.byte_array = _nbt_alloc(tag, length);
+			nbt_coder_decode_data(coder, (char*)tag->payload.tag_byte_array.byte_array, length);
+			break;
 		}
 		case NBT_INT_ARRAY: {
 			int32_t length = nbt_coder_decode_int(coder, order);
-			int32_t array[length * sizeof(int32_t)];
-			for (int32_t i = 0; i < length; i++) {
-				array[i] = nbt_coder_decode_int(coder, order);
+			assert(length >= 0);
+			if (!_nbt_parse_spend(context, sizeof(int32_t) * (size_t)length)) {
+				break;
 			}
-			return nbt_create_int_array(name, array, length);
+			tag->payload.tag_int_array.length = length;
+			tag->payload.tag_int_array.int_array = _nbt_alloc(tag, sizeof(int32_t) * length);
+			nbt_coder_decode_ints(coder, tag->payload.tag_int_array.int_array, length, order);
+			break;
+		}
+		case NBT_LONG_ARRAY: {
+			int32_t length = nbt_coder_decode_int(coder, order);
+			assert(length >= 0);
+			if (!_nbt_parse_spend(context, _nbt_long_array_size(length, order))) {
+				break;
+			}
+			/* Keep the wire bytes, nbt_long_array makes a native copy if anyone asks */
+			int64_t* longs = _nbt_long_array_alloc(tag, length, order);
+			nbt_coder_decode_data(coder, (char*)longs, sizeof(int64_t) * length);
+			break;
 		}
 		case NBT_STRING: {
-			int16_t length = nbt_coder_decode_short(coder, order);
-			char* string = malloc(length + 1);
+			uint16_t length = nbt_coder_decode_short(coder, order);
+			if (context->options.flags & NBT_PARSE_BORROW) {
+				tag->payload.tag_string.length = length;
+				tag->payload.tag_string.string = (char*)_nbt_parse_borrow(tag, coder, length);
+				break;
+			}
+			if (!_nbt_parse_spend(context, length + 1)) {
+				break;
+			}
+			/* Straight into the node's own copy */
+			char* string = _nbt_alloc(tag, length + 1);
 			nbt_coder_decode_data(coder, string, length);
 			string[length] = '\0';
-			return nbt_create_string(name, string);
+			tag->payload.tag_string.length = length;
+			tag->payload.tag_string.string = string;
+			break;
 		}
 		case NBT_LIST: {
 			nbt_type_t list_type = nbt_coder_decode_byte(coder);
-			nbt_t* tag = nbt_create_list(name, list_type);
+			tag->element_type = list_type;
 			int32_t count = nbt_coder_decode_int(coder, order);
-			for (int32_t i = 0; i < count; i++) {
-				nbt_list_add(tag, _nbt_parse_payload(list_type, NULL, coder, order, errorp));
+			size_t width = _nbt_packed_width(list_type);
+			if (width) {
+				tag->flags |= NBT_FLAG_PACKED;
+			}
+			/* Elements that aren't packed are a node and a pointer each, counted before anything's reserved */
+			if (count > 0 && !_nbt_parse_spend(context, (width ? width : sizeof(nbt_t) + sizeof(nbt_t*)) * (size_t)count)) {
+				break;
 			}
-			return tag;
+			if (width && count > 0) {
+				/* Straight into the packed array, as long as the input really has it */
+				assert(!_nbt_coder_whole(coder) || (size_t)count * width <= nbt_coder_size(coder) - _nbt_coder_tell(coder));
+				_nbt_parse_packed(tag, coder, order, width, count);
+				break;
+			}
+			_nbt_list_reserve(tag, _nbt_parse_reserve(coder, count));
+			*remaining = count;
+			return count > 0;
 		}
-		case NBT_COMPOUND: {
-			nbt_t* tag = nbt_create_compound(name);
-			nbt_t* next = NULL;
-			while ((next = _nbt_parse_coder(coder, order, errorp))) {
-				nbt_compound_set(tag, next);
+		case NBT_COMPOUND:
+			return true;
+	}
+	return false;
+}
+
+/* Iterative, so however deep the input nests it can't run out of stack */
+nbt_t* _nbt_parse_payload(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	struct nbt_parse_frame inline_frames[NBT_PARSE_INLINE_DEPTH];
+	struct nbt_parse_frame* frames = inline_frames;
+	size_t reserved = NBT_PARSE_INLINE_DEPTH;
+	size_t depth = 0;
+	nbt_t* node = tag;
+	while (node) {
+		struct nbt_parse_frame frame = { node, 0 };
+		if (_nbt_parse_value(node, coder, order, context, &frame.remaining)) {
+			if (depth == reserved) {
+				struct nbt_parse_frame* grown = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				if (!grown) {
+					context->status = NBT_ERROR_MEMORY;
+					break;
+				}
+				frames = grown;
+			}
+			frames[depth++] = frame;
+		}
+		
+		/* The next child of the innermost container that has one left, already in its place */
+		node = NULL;
+		while (depth && !node && !context->status) {
+			struct nbt_parse_frame* top = &frames[depth - 1];
+			if (top->tag->type == NBT_COMPOUND) {
+				node = _nbt_parse_header(coder, order, context);
+				if (node) {
+					nbt_compound_set(top->tag, node);
+				}
+			} else if (top->remaining > 0) {
+				top->remaining--;
+				node = _nbt_create_in(context->arena, top->tag->element_type, NULL, 0);
+				nbt_list_add(top->tag, node);
+			}
+			if (!node) {
+				depth--;
+			} else if (_nbt_parse_deferred(node, coder, order, context)) {
+				node = NULL;
 			}
-			return tag;
 		}
 	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+	return tag;
+}
+
+nbt_t* _nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	nbt_t* tag = _nbt_parse_header(coder, order, context);
+	return tag ? _nbt_parse_child(tag, coder, order, context) : NULL;
 }
 
-nbt_t* _nbt_parse_coder(nbt_coder_t* coder, nbt_byte_order_t order, nbt_status_t* errorp) {
+/* A named tag's type and name, NULL at the END of a compound */
+nbt_t* _nbt_parse_header(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
 	nbt_type_t type = nbt_coder_decode_byte(coder);
 	if (!type) {
 		return NULL;
 	}
-	int16_t name_length = nbt_coder_decode_short(coder, order);
-	char* name = malloc(name_length + 1);
-	nbt_coder_decode_data(coder, name, name_length);
-	name[name_length] = '\0';
-	nbt_t* tag = _nbt_parse_payload(type, name, coder, order, errorp);
-	free(name);
+	uint16_t name_length = nbt_coder_decode_short(coder, order);
+	if (!_nbt_parse_spend(context, sizeof(nbt_t) + (name_length < NBT_INLINE_NAME ? 0 : name_length + 1))) {
+		return NULL;
+	}
+	/* Everything the node owns comes from the same place as the node, see _nbt_alloc */
+	nbt_t* tag = _nbt_create_in(context->arena, type, NULL, 0);
+	if (name_length < NBT_INLINE_NAME) {
+		/* Straight into the node, which is zeroed so it's already terminated */
+		tag->flags |= NBT_FLAG_NAMED;
+		tag->name_length = name_length;
+		nbt_coder_decode_data(coder, tag->name.bytes, name_length);
+	} else {
+		/* Nodes copy their name or point at an atom, so the scratch copy can be reused straight away */
+		char* name = _nbt_context_scratch(&context->name, &context->name_reserved, name_length);
+		nbt_coder_decode_data(coder, name, name_length);
+		_nbt_parse_name(tag, name, name_length, context);
+	}
 	return tag;
 }
+
+/* A run of count numbers, in one go from a whole coder, and in pieces that grow as they arrive from a stream, which could be lying about count */
+void _nbt_parse_packed(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, size_t width, int32_t count) {
+	struct nbt_list* elements = &tag->payload.tag_list;
+	while (elements->count < count) {
+		if (elements->count == elements->reserved) {
+			int32_t done = elements->count;
+			_nbt_list_reserve(tag, done ? (done > count / 2 ? count : done * 2) : _nbt_parse_reserve(coder, count));
+		}
+		int32_t run = (count < elements->reserved ? count : elements->reserved) - elements->count;
+		void* values = (char*)elements->elements.values + width * elements->count;
+		switch (width) {
+			case sizeof(int8_t):
+				nbt_coder_decode_data(coder, values, run);
+				break;
+			case sizeof(int16_t):
+				nbt_coder_decode_shorts(coder, values, run, order);
+				break;
+			case sizeof(int32_t):
+				nbt_coder_decode_ints(coder, values, run, order);
+				break;
+			case sizeof(int64_t):
+				nbt_coder_decode_longs(coder, values, run, order);
+				break;
+		}
+		elements->count += run;
+	}
+}
+
+/* Room for the elements of a list the input says has count, no more than the rest of the input could hold at a byte each */
+int32_t _nbt_parse_reserve(nbt_coder_t* coder, int32_t count) {
+	size_t room = NBT_PARSE_STREAM_RESERVE;
+	if (_nbt_coder_whole(coder)) {
+		room = nbt_coder_size(coder) - _nbt_coder_tell(coder);
+	}
+	return count > 0 && (size_t)count > room ? (int32_t)room : count;
+}
+
+/* Name a new node after a decoded name, pointing it at an atom if the options ask for one */
+void _nbt_parse_name(nbt_t* tag, const char* name, size_t length, nbt_context_t* context) {
+	const char* atom = NULL;
+	if (context->options.flags & NBT_PARSE_INTERN && length >= NBT_INLINE_NAME) {
+		atom = _nbt_context_atom(context, name, length);
+	}
+	if (atom) {
+		tag->flags |= NBT_FLAG_NAMED | NBT_FLAG_ATOM;
+		tag->name_length = length;
+		tag->name.pointer = (char*)atom;
+	} else {
+		_nbt_set_name(tag, name, length);
+	}
+}
+
+/* The next length bytes where they are, in the caller's input or the source the arena keeps */
+const char* _nbt_parse_borrow(nbt_t* tag, nbt_coder_t* coder, size_t length) {
+	assert(tag->flags & NBT_FLAG_ARENA);
+	const char* bytes = nbt_coder_data(coder) + _nbt_coder_tell(coder);
+	_nbt_coder_skip(coder, length);
+	tag->flags |= NBT_FLAG_BORROWED;
+	return bytes;
+}
+
+nbt_t* _nbt_parse_child(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	if (_nbt_parse_deferred(tag, coder, order, context)) {
+		return tag;
+	}
+	return _nbt_parse_payload(tag, coder, order, context);
+}
+
+/* A lazy parse only notes where anything that would allocate is and moves past it */
+bool _nbt_parse_deferred(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	if (context->source && tag->type != NBT_END && !_nbt_packed_width(tag->type)) {
+		_nbt_defer(tag, context->source, _nbt_coder_tell(coder));
+		_nbt_skip_payload(coder, tag->type, order);
+		return true;
+	}
+	return false;
+}
+
+/* Containers still being skipped, a compound runs until its END and a list for its count */
+struct nbt_skip_frame {
+	bool compound;
+	nbt_type_t element_type;
+	int32_t remaining;
+};
+
+#define NBT_SKIP_INLINE_DEPTH 32
+
+/* Past a payload by its length prefixes alone, nothing is decoded or allocated however deep it goes */
+void _nbt_skip_payload(nbt_coder_t* coder, nbt_type_t type, nbt_byte_order_t order) {
+	struct nbt_skip_frame inline_frames[NBT_SKIP_INLINE_DEPTH];
+	struct nbt_skip_frame* frames = inline_frames;
+	size_t reserved = NBT_SKIP_INLINE_DEPTH;
+	size_t depth = 0;
+	for (;;) {
+		struct nbt_skip_frame frame = { false, NBT_END, 0 };
+		switch (type) {
+			case NBT_BYTE_ARRAY:
+			case NBT_INT_ARRAY:
+			case NBT_LONG_ARRAY: {
+				int32_t length = nbt_coder_decode_int(coder, order);
+				assert(length >= 0);
+				size_t width = type == NBT_BYTE_ARRAY ? sizeof(int8_t) : type == NBT_INT_ARRAY ? sizeof(int32_t) : sizeof(int64_t);
+				_nbt_coder_skip(coder, width * length);
+				break;
+			}
+			case NBT_STRING:
+				_nbt_coder_skip(coder, (uint16_t)nbt_coder_decode_short(coder, order));
+				break;
+			case NBT_LIST: {
+				frame.element_type = nbt_coder_decode_byte(coder);
+				frame.remaining = nbt_coder_decode_int(coder, order);
+				size_t width = _nbt_packed_width(frame.element_type);
+				if (width || frame.element_type == NBT_END) {
+					/* count x width, no need to look at the elements */
+					if (frame.remaining > 0) {
+						_nbt_coder_skip(coder, width * frame.remaining);
+					}
+					frame.remaining = 0;
+				}
+				break;
+			}
+			case NBT_COMPOUND:
+				frame.compound = true;
+				break;
+			default:
+				_nbt_coder_skip(coder, _nbt_packed_width(type));
+				break;
+		}
+		if (frame.compound || frame.remaining > 0) {
+			if (depth == reserved) {
+				frames = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				/* Only trusted input gets skipped like this, the same as running out anywhere else */
+				assert(frames);
+			}
+			frames[depth++] = frame;
+		}
+		
+		/* The next payload of the innermost container that has one left */
+		type = NBT_END;
+		while (depth && type == NBT_END) {
+			struct nbt_skip_frame* top = &frames[depth - 1];
+			if (top->compound) {
+				type = nbt_coder_decode_byte(coder);
+				if (type != NBT_END) {
+					_nbt_coder_skip(coder, (uint16_t)nbt_coder_decode_short(coder, order));
+				}
+			} else if (top->remaining > 0) {
+				top->remaining--;
+				type = top->element_type;
+			}
+			if (type == NBT_END) {
+				depth--;
+			}
+		}
+		if (type == NBT_END) {
+			break;
+		}
+	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+}
@@ -46,30 +46,53 @@ const char* _nbt_type_names[] = {
 	"TAG_String",
 	"TAG_List",
 	"TAG_Compound",
-	"TAG_Int_Array"
+	"TAG_Int_Array",
+	"TAG_Long_Array"
 };
 
 char* nbt_printf(const char* format, ...) __printflike(1, 2);
 char* nbt_vprintf(const char* format, va_list ap) __printflike(1, 0);
 
-char* _nbt_tabs(size_t count);
-char* _nbt_spaces(size_t count);
+/* The output is built up in one buffer as the tree is walked */
+struct nbt_print_state {
+	nbt_print_style_t style;
+	char* data;
+	size_t length;
+	size_t reserved;
+	
+	/* Pipe style: what goes in front of each line, and where each open container's children start */
+	char* prefix;
+	size_t prefix_length;
+	size_t prefix_reserved;
+	size_t* children_start;
+	size_t children_reserved;
+};
 
-char* _nbt_print_original(nbt_t* tag, int tab_count);
-char* _nbt_print_pipe(nbt_t* tag, const char* start_string);
-char* _nbt_print_color(nbt_t* tag, int tab_count);
+void _nbt_print_append(struct nbt_print_state* state, const char* format, ...) __printflike(2, 3);
+void _nbt_print_append_data(char** buffer, size_t* length, size_t* reserved, const char* data, size_t count);
+void _nbt_print_append_repeated(char** buffer, size_t* length, size_t* reserved, char character, size_t count);
+char* _nbt_print_label(nbt_t* tag, bool color);
+void _nbt_print_value(struct nbt_print_state* state, nbt_t* tag);
+bool _nbt_print_has_children(nbt_t* tag);
+nbt_walk_action_t _nbt_print_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+nbt_walk_action_t _nbt_print_leave(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+nbt_walk_action_t _nbt_print_pipe(nbt_t* tag, const nbt_walk_position_t* position, void* context);
 
 char* nbt_print(nbt_t* tag, nbt_print_style_t style) {
-	switch (style) {
-		case NBT_STYLE_ORIGINAL:
-			return _nbt_print_original(tag, 0);
-			break;
-		case NBT_STYLE_PIPE:
-			return _nbt_print_pipe(tag, "");
-			break;
-		case NBT_STYLE_COLOR:
-			return _nbt_print_color(tag, 0);
+	struct nbt_print_state state;
+	memset(&state, 0, sizeof(state));
+	state.style = style;
+	if (style == NBT_STYLE_PIPE) {
+		nbt_walk(tag, _nbt_print_pipe, NULL, &state);
+	} else {
+		nbt_walk(tag, _nbt_print_enter, _nbt_print_leave, &state);
+	}
+	free(state.prefix);
+	free(state.children_start);
+	if (!state.data) {
+		return strdup("");
 	}
+	return state.data;
 }
 
 char* nbt_printf(const char* format, ...) {
@@ -86,288 +109,169 @@ char* nbt_vprintf(const char* format, va_list ap) {
 	return print;
 }
 
-char* _nbt_tabs(size_t count) {
-	char* print = malloc(count + 1);
-	memset(print, '\t', count);
-	print[count] = '\0';
-	return print;
+void _nbt_print_append(struct nbt_print_state* state, const char* format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	size_t available = state->reserved - state->length;
+	int length = vsnprintf(state->data ? state->data + state->length : NULL, available, format, ap);
+	va_end(ap);
+	if ((size_t)length >= available) {
+		/* Didn't fit, grow and go again */
+		size_t reserved = state->reserved ? state->reserved : 256;
+		while (reserved < state->length + length + 1) {
+			reserved <<= 1;
+		}
+		state->data = realloc(state->data, reserved);
+		state->reserved = reserved;
+		va_start(ap, format);
+		vsnprintf(state->data + state->length, state->reserved - state->length, format, ap);
+		va_end(ap);
+	}
+	state->length += length;
 }
 
-char* _nbt_spaces(size_t count) {
-	char* print = malloc(count + 1);
-	memset(print, ' ', count);
-	print[count] = '\0';
-	return print;
+void _nbt_print_append_data(char** buffer, size_t* length, size_t* reserved, const char* data, size_t count) {
+	if (*length + count + 1 > *reserved) {
+		size_t grown = *reserved ? *reserved : 256;
+		while (grown < *length + count + 1) {
+			grown <<= 1;
+		}
+		*buffer = realloc(*buffer, grown);
+		*reserved = grown;
+	}
+	memcpy(*buffer + *length, data, count);
+	*length += count;
+	(*buffer)[*length] = '\0';
 }
 
-char* _nbt_print_original(nbt_t* tag, int tab_count) {
-	char* start;
-	if (tag->name) {
-		start = nbt_printf("%s(\"%s\")", _nbt_type_names[tag->type], tag->name);
-	} else {
-		start = nbt_printf("%s", _nbt_type_names[tag->type]);
+void _nbt_print_append_repeated(char** buffer, size_t* length, size_t* reserved, char character, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		_nbt_print_append_data(buffer, length, reserved, &character, 1);
 	}
-	char* tabs = _nbt_tabs(tab_count);
-	char* print;
-	switch (tag->type) {
-		case NBT_END:
-			print = strdup("");
-			break;
-		case NBT_BYTE:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_byte);
-			break;
-		case NBT_SHORT:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_short);
-			break;
-		case NBT_INT:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_int);
-			break;
-		case NBT_LONG:
-			print = nbt_printf("%s%s: %lld\n", tabs, start, tag->payload.tag_long);
-			break;
-		case NBT_FLOAT:
-			print = nbt_printf("%s%s: %f\n", tabs, start, tag->payload.tag_float);
-			break;
-		case NBT_DOUBLE:
-			print = nbt_printf("%s%s: %lf\n", tabs, start, tag->payload.tag_double);
-			break;
-		case NBT_STRING:
-			print = nbt_printf("%s%s: %s\n", tabs, start, tag->payload.tag_string);
-			break;
-		case NBT_BYTE_ARRAY:
-			print = nbt_printf("%s%s: [%d bytes]\n", tabs, start, tag->payload.tag_byte_array.length);
-			break;
-		case NBT_INT_ARRAY:
-			print = nbt_printf("%s%s: [%d ints]\n", tabs, start, tag->payload.tag_int_array.length);
-			break;
-		case NBT_LIST:
-		{
-			print = nbt_printf("%s%s: %d entries of type %s\n%s{\n", tabs, start, nbt_list_count(tag), _nbt_type_names[tag->payload.tag_list.type], tabs);
-			nbt_t* item = tag->payload.tag_list.tree;
-			char* temp;
-			do {
-				char* next = _nbt_print_original(item, tab_count + 1);
-				temp = nbt_printf("%s%s", print, next);
-				free(print);
-				free(next);
-				print = temp;
-			} while ((item = item->tree_right));
-			temp = nbt_printf("%s%s}\n", print, tabs);
-			free(print);
-			print = temp;
-			break;
+}
+
+char* _nbt_print_label(nbt_t* tag, bool color) {
+	const char* name = _nbt_name(tag);
+	if (color) {
+		if (name) {
+			return nbt_printf(XLBLUE "%s" XYELLOW "(" "\x1b[38;5;208m" "\"%s\"" XYELLOW ")" RESET, _nbt_type_names[tag->type], name);
 		}
-		case NBT_COMPOUND:
-			print = nbt_printf("%s%s: %d entries\n%s{\n", tabs, start, _nbt_tree_count(tag->payload.tag_compound), tabs);
-			nbt_t* item = tag->payload.tag_compound;
-			char* temp;
-			do {
-				char* next = _nbt_print_original(item, tab_count + 1);
-				temp = nbt_printf("%s%s", print, next);
-				free(print);
-				free(next);
-				print = temp;
-			} while ((item = item->tree_right));
-			temp = nbt_printf("%s%s}\n", print, tabs);
-			free(print);
-			print = temp;
-			break;
+		return nbt_printf(XLBLUE "%s" RESET, _nbt_type_names[tag->type]);
 	}
-	free(tabs);
-	return print;
+	if (name) {
+		return nbt_printf("%s(\"%s\")", _nbt_type_names[tag->type], name);
+	}
+	return nbt_printf("%s", _nbt_type_names[tag->type]);
 }
 
-char* _nbt_print_pipe(nbt_t* tag, const char* start_string) {
-	char* start;
-	if (tag->name) {
-		start = nbt_printf("%s(\"%s\")", _nbt_type_names[tag->type], tag->name);
-	} else {
-		start = nbt_printf("%s", _nbt_type_names[tag->type]);
-	}
-	char* print;
+/* Everything after the label for anything that isn't a container */
+void _nbt_print_value(struct nbt_print_state* state, nbt_t* tag) {
 	switch (tag->type) {
-		case NBT_END:
-			print = strdup("");
-			break;
 		case NBT_BYTE:
-			print = nbt_printf("%s: %d\n", start, tag->payload.tag_byte);
+			_nbt_print_append(state, ": %d\n", tag->payload.tag_byte);
 			break;
 		case NBT_SHORT:
-			print = nbt_printf("%s: %d\n", start, tag->payload.tag_short);
+			_nbt_print_append(state, ": %d\n", tag->payload.tag_short);
 			break;
 		case NBT_INT:
-			print = nbt_printf("%s: %d\n", start, tag->payload.tag_int);
+			_nbt_print_append(state, ": %d\n", tag->payload.tag_int);
 			break;
 		case NBT_LONG:
-			print = nbt_printf("%s: %lld\n", start, tag->payload.tag_long);
+			_nbt_print_append(state, ": %lld\n", (long long)tag->payload.tag_long);
 			break;
 		case NBT_FLOAT:
-			print = nbt_printf("%s: %f\n", start, tag->payload.tag_float);
+			_nbt_print_append(state, ": %f\n", tag->payload.tag_float);
 			break;
 		case NBT_DOUBLE:
-			print = nbt_printf("%s: %lf\n", start, tag->payload.tag_double);
+			_nbt_print_append(state, ": %lf\n", tag->payload.tag_double);
 			break;
 		case NBT_STRING:
-			print = nbt_printf("%s: %s\n", start, tag->payload.tag_string);
+			/* By length, borrowed strings aren't NUL terminated */
+			_nbt_print_append(state, ": %.*s\n", (int)tag->payload.tag_string.length, _nbt_string_bytes(tag));
 			break;
 		case NBT_BYTE_ARRAY:
-			print = nbt_printf("%s: [%d bytes]\n", start, tag->payload.tag_byte_array.length);
+			_nbt_print_append(state, ": [%d bytes]\n", tag->payload.tag_byte_array.length);
 			break;
 		case NBT_INT_ARRAY:
-			print = nbt_printf("%s: [%d ints]\n", start, tag->payload.tag_int_array.length);
+			_nbt_print_append(state, ": [%d ints]\n", tag->payload.tag_int_array.length);
 			break;
-		case NBT_LIST:
-		{
-			char* spaces = _nbt_spaces(strlen(start) + 2);
-			char* new_start_string_pipe    = nbt_printf("%s%s│  ", start_string, spaces);
-			char* new_start_string_no_pipe = nbt_printf("%s%s   ", start_string, spaces);
-			char* new_start_string_before  = nbt_printf("%s%s", start_string, spaces);
-			free(spaces);
-			char* temp;
-			nbt_t* item = tag->payload.tag_list.tree;
-			if (item->tree_right) {
-				char* child_print = _nbt_print_pipe(item, new_start_string_pipe);
-				print = nbt_printf("%s ─┬─ %s", start, child_print);
-				free(child_print);
-				item = item->tree_right;
-				while (item->tree_right) {
-					child_print = _nbt_print_pipe(item, new_start_string_pipe);
-					temp = nbt_printf("%s%s├─ %s", print, new_start_string_before, child_print);
-					free(print);
-					print = temp;
-					free(child_print);
-					item = item->tree_right;
-				}
-				child_print = _nbt_print_pipe(item, new_start_string_no_pipe);
-				temp = nbt_printf("%s%s└─ %s", print, new_start_string_before, child_print);
-				free(print);
-				print = temp;
-				free(child_print);
-			} else {
-				char* child_print = _nbt_print_pipe(item, new_start_string_no_pipe);
-				print = nbt_printf("%s ─── %s", start, child_print);
-				free(child_print);
-			}
-			free(new_start_string_pipe);
-			free(new_start_string_no_pipe);
-			free(new_start_string_before);
+		case NBT_LONG_ARRAY:
+			_nbt_print_append(state, ": [%d longs]\n", tag->payload.tag_long_array.length);
 			break;
-		}
-		case NBT_COMPOUND:
-		{
-			char* spaces = _nbt_spaces(strlen(start) + 2);
-			char* new_start_string_pipe    = nbt_printf("%s%s│  ", start_string, spaces);
-			char* new_start_string_no_pipe = nbt_printf("%s%s   ", start_string, spaces);
-			char* new_start_string_before  = nbt_printf("%s%s", start_string, spaces);
-			free(spaces);
-			char* temp;
-			nbt_t* item = tag->payload.tag_compound;
-			if (item->tree_right) {
-				char* child_print = _nbt_print_pipe(item, new_start_string_pipe);
-				print = nbt_printf("%s ─┬─ %s", start, child_print);
-				free(child_print);
-				item = item->tree_right;
-				while (item->tree_right) {
-					child_print = _nbt_print_pipe(item, new_start_string_pipe);
-					temp = nbt_printf("%s%s├─ %s", print, new_start_string_before, child_print);
-					free(print);
-					print = temp;
-					free(child_print);
-					item = item->tree_right;
-				}
-				child_print = _nbt_print_pipe(item, new_start_string_no_pipe);
-				temp = nbt_printf("%s%s└─ %s", print, new_start_string_before, child_print);
-				free(print);
-				print = temp;
-				free(child_print);
-			} else {
-				char* child_print = _nbt_print_pipe(item, new_start_string_no_pipe);
-				print = nbt_printf("%s ─── %s", start, child_print);
-				free(child_print);
-			}
-			free(new_start_string_pipe);
-			free(new_start_string_no_pipe);
-			free(new_start_string_before);
+		default:
 			break;
-		}
 	}
-	free(start);
-	return print;
 }
 
-char* _nbt_print_color(nbt_t* tag, int tab_count) {
-	char* start;
-	if (tag->name) {
-		start = nbt_printf(XLBLUE "%s" XYELLOW "(" "\x1b[38;5;208m" "\"%s\"" XYELLOW ")" RESET, _nbt_type_names[tag->type], tag->name);
+bool _nbt_print_has_children(nbt_t* tag) {
+	return (tag->type == NBT_COMPOUND && tag->payload.tag_compound.head) || (tag->type == NBT_LIST && tag->payload.tag_list.count);
+}
+
+/* The original and color styles: indented, with containers in braces */
+nbt_walk_action_t _nbt_print_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	struct nbt_print_state* state = context;
+	bool color = state->style == NBT_STYLE_COLOR;
+	if (tag->type == NBT_END) {
+		return NBT_WALK_CONTINUE;
+	}
+	char* label = _nbt_print_label(tag, color);
+	_nbt_print_append_repeated(&state->data, &state->length, &state->reserved, '\t', position->depth);
+	_nbt_print_append(state, "%s", label);
+	free(label);
+	if (tag->type == NBT_LIST) {
+		_nbt_print_append(state, color ? ": %d entries of type " XLBLUE "%s" XLBLUE "\n" : ": %d entries of type %s\n", tag->payload.tag_list.count, _nbt_type_names[tag->element_type]);
+	} else if (tag->type == NBT_COMPOUND) {
+		_nbt_print_append(state, ": %d entries\n", _nbt_tree_count(tag->payload.tag_compound.head));
 	} else {
-		start = nbt_printf(XLBLUE "%s" RESET, _nbt_type_names[tag->type]);
+		_nbt_print_value(state, tag);
+		return NBT_WALK_CONTINUE;
 	}
-	char* tabs = _nbt_tabs(tab_count);
-	char* print;
-	switch (tag->type) {
-		case NBT_END:
-			print = strdup("");
-			break;
-		case NBT_BYTE:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_byte);
-			break;
-		case NBT_SHORT:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_short);
-			break;
-		case NBT_INT:
-			print = nbt_printf("%s%s: %d\n", tabs, start, tag->payload.tag_int);
-			break;
-		case NBT_LONG:
-			print = nbt_printf("%s%s: %lld\n", tabs, start, tag->payload.tag_long);
-			break;
-		case NBT_FLOAT:
-			print = nbt_printf("%s%s: %f\n", tabs, start, tag->payload.tag_float);
-			break;
-		case NBT_DOUBLE:
-			print = nbt_printf("%s%s: %lf\n", tabs, start, tag->payload.tag_double);
-			break;
-		case NBT_STRING:
-			print = nbt_printf("%s%s: %s\n", tabs, start, tag->payload.tag_string);
-			break;
-		case NBT_BYTE_ARRAY:
-			print = nbt_printf("%s%s: [%d bytes]\n", tabs, start, tag->payload.tag_byte_array.length);
-			break;
-		case NBT_INT_ARRAY:
-			print = nbt_printf("%s%s: [%d ints]\n", tabs, start, tag->payload.tag_int_array.length);
-			break;
-		case NBT_LIST:
-		{
-			print = nbt_printf("%s%s: %d entries of type " XLBLUE "%s" XLBLUE "\n%s" XYELLOW "{" RESET "\n", tabs, start, nbt_list_count(tag), _nbt_type_names[tag->payload.tag_list.type], tabs);
-			nbt_t* item = tag->payload.tag_list.tree;
-			char* temp;
-			do {
-				char* next = _nbt_print_color(item, tab_count + 1);
-				temp = nbt_printf("%s%s", print, next);
-				free(print);
-				free(next);
-				print = temp;
-			} while ((item = item->tree_right));
-			temp = nbt_printf("%s%s" XYELLOW "}" RESET "\n", print, tabs);
-			free(print);
-			print = temp;
-			break;
+	_nbt_print_append_repeated(&state->data, &state->length, &state->reserved, '\t', position->depth);
+	_nbt_print_append(state, color ? XYELLOW "{" RESET "\n" : "{\n");
+	return NBT_WALK_CONTINUE;
+}
+
+nbt_walk_action_t _nbt_print_leave(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	struct nbt_print_state* state = context;
+	if (tag->type == NBT_LIST || tag->type == NBT_COMPOUND) {
+		_nbt_print_append_repeated(&state->data, &state->length, &state->reserved, '\t', position->depth);
+		_nbt_print_append(state, state->style == NBT_STYLE_COLOR ? XYELLOW "}" RESET "\n" : "}\n");
+	}
+	return NBT_WALK_CONTINUE;
+}
+
+/* The pipe style: children hang off their container's label in a tree */
+nbt_walk_action_t _nbt_print_pipe(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	struct nbt_print_state* state = context;
+	if (position->parent) {
+		/* Back to the parent's indent, anything deeper belonged to an earlier sibling */
+		size_t children_start = state->children_start[position->depth - 1];
+		state->prefix_length = children_start;
+		if (position->index == 0) {
+			_nbt_print_append(state, "%s", position->last ? " ─── " : " ─┬─ ");
+		} else {
+			_nbt_print_append(state, "%.*s%s", (int)children_start, state->prefix, position->last ? "└─ " : "├─ ");
 		}
-		case NBT_COMPOUND:
-			print = nbt_printf("%s%s: %d entries\n%s" XYELLOW "{" RESET "\n", tabs, start, _nbt_tree_count(tag->payload.tag_compound), tabs);
-			nbt_t* item = tag->payload.tag_compound;
-			char* temp;
-			do {
-				char* next = _nbt_print_color(item, tab_count + 1);
-				temp = nbt_printf("%s%s", print, next);
-				free(print);
-				free(next);
-				print = temp;
-			} while ((item = item->tree_right));
-			temp = nbt_printf("%s%s" XYELLOW "}" RESET "\n", print, tabs);
-			free(print);
-			print = temp;
-			break;
+		const char* continuation = position->last ? "   " : "│  ";
+		_nbt_print_append_data(&state->prefix, &state->prefix_length, &state->prefix_reserved, continuation, strlen(continuation));
 	}
-	free(tabs);
-	return print;
+	if (tag->type == NBT_END) {
+		return NBT_WALK_CONTINUE;
+	}
+	char* label = _nbt_print_label(tag, false);
+	_nbt_print_append(state, "%s", label);
+	if (_nbt_print_has_children(tag)) {
+		if (position->depth >= state->children_reserved) {
+			state->children_reserved = state->children_reserved ? state->children_reserved * 2 : 16;
+			state->children_start = realloc(state->children_start, sizeof(*state->children_start) * state->children_reserved);
+		}
+		_nbt_print_append_repeated(&state->prefix, &state->prefix_length, &state->prefix_reserved, ' ', strlen(label) + 2);
+		state->children_start[position->depth] = state->prefix_length;
+	} else if (tag->type == NBT_LIST || tag->type == NBT_COMPOUND) {
+		_nbt_print_append(state, "\n");
+	} else {
+		_nbt_print_value(state, tag);
+	}
+	free(label);
+	return NBT_WALK_CONTINUE;
 }
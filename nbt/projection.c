@@ -0,0 +1,262 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  projection.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* A trie of path segments, the root stands for the root tag and has no name */
+struct nbt_projection {
+	char* name;
+	size_t length;
+	bool whole;	/* a path ends here, everything under it is kept */
+	nbt_projection_t* children;
+	size_t count;
+};
+
+/* Containers still being projected, a list runs for its count and a compound until its END */
+struct nbt_projected_frame {
+	nbt_t* tag;
+	const nbt_projection_t* projection;	/* where tag is in the trie, its elements are too if it's a list */
+	int32_t remaining;
+	bool kept;	/* something under tag is on a path */
+};
+
+#define NBT_PROJECTED_INLINE_DEPTH 32
+
+void _nbt_projection_clear(nbt_projection_t* projection);
+const nbt_projection_t* _nbt_projection_child(const nbt_projection_t* projection, const char* name, size_t length);
+nbt_t* _nbt_parse_projected(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context);
+bool _nbt_parse_projected_value(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, struct nbt_projected_frame* frame, bool* kept);
+void _nbt_parse_projected_link(struct nbt_projected_frame* parent, nbt_t* tag, bool kept);
+
+nbt_projection_t* nbt_projection_create(const char* const* paths, size_t count) {
+	nbt_projection_t* root = malloc(sizeof(*root));
+	memset(root, 0, sizeof(*root));
+	for (size_t i = 0; i < count; i++) {
+		nbt_projection_t* node = root;
+		const char* segment = paths[i];
+		/* An empty path is the whole tree */
+		bool more = *segment != '\0';
+		while (more) {
+			size_t length = strcspn(segment, ".");
+			nbt_projection_t* child = (nbt_projection_t*)_nbt_projection_child(node, segment, length);
+			if (!child) {
+				node->children = realloc(node->children, sizeof(*node->children) * (node->count + 1));
+				child = &node->children[node->count++];
+				memset(child, 0, sizeof(*child));
+				child->name = malloc(length + 1);
+				memcpy(child->name, segment, length);
+				child->name[length] = '\0';
+				child->length = length;
+			}
+			node = child;
+			more = segment[length] == '.';
+			segment += length + 1;
+		}
+		node->whole = true;
+	}
+	return root;
+}
+
+void nbt_projection_release(nbt_projection_t* projection) {
+	if (projection) {
+		_nbt_projection_clear(projection);
+		free(projection);
+	}
+}
+
+/* Only as deep as the longest path, so recursing is fine */
+void _nbt_projection_clear(nbt_projection_t* projection) {
+	for (size_t i = 0; i < projection->count; i++) {
+		_nbt_projection_clear(&projection->children[i]);
+	}
+	free(projection->children);
+	free(projection->name);
+}
+
+const nbt_projection_t* _nbt_projection_child(const nbt_projection_t* projection, const char* name, size_t length) {
+	for (size_t i = 0; i < projection->count; i++) {
+		const nbt_projection_t* child = &projection->children[i];
+		if (child->length == length && !memcmp(child->name, name, length)) {
+			return child;
+		}
+	}
+	return NULL;
+}
+nbt_t* _nbt_parse_projected_root(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	nbt_t* tag = _nbt_parse_header(coder, order, context);
+	if (!tag) {
+		return NULL;
+	}
+	if (!_nbt_parse_projected(tag, coder, order, context)) {
+		nbt_release(tag);
+		return NULL;
+	}
+	return tag;
+}
+
+/* A payload up to its children, true if it has some still to come, otherwise kept says whether anything in it is on a path */
+bool _nbt_parse_projected_value(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context, struct nbt_projected_frame* frame, bool* kept) {
+	*kept = false;
+	if (frame->projection->whole) {
+		_nbt_parse_payload(tag, coder, order, context);
+		*kept = true;
+		return false;
+	}
+	switch (tag->type) {
+		case NBT_COMPOUND:
+			return true;
+		case NBT_LIST: {
+			nbt_type_t list_type = nbt_coder_decode_byte(coder);
+			int32_t count = nbt_coder_decode_int(coder, order);
+			tag->element_type = list_type;
+			if (list_type != NBT_COMPOUND && list_type != NBT_LIST) {
+				/* The rest of the path can't go into any of the elements */
+				size_t width = _nbt_packed_width(list_type);
+				if (width && count > 0) {
+					_nbt_coder_skip(coder, width * count);
+				} else if (list_type != NBT_END) {
+					for (int32_t i = 0; i < count; i++) {
+						_nbt_skip_payload(coder, list_type, order);
+					}
+				}
+				return false;
+			}
+			/* A node and a pointer each, whether or not anything under them is kept */
+			if (count > 0 && !_nbt_parse_spend(context, (sizeof(nbt_t) + sizeof(nbt_t*)) * (size_t)count)) {
+				return false;
+			}
+			_nbt_list_reserve(tag, _nbt_parse_reserve(coder, count));
+			frame->remaining = count;
+			return count > 0;
+		}
+		default:
+			_nbt_skip_payload(coder, tag->type, order);
+			return false;
+	}
+}
+
+/* A finished child goes into its container, a compound only keeps it if something in it is on a path */
+void _nbt_parse_projected_link(struct nbt_projected_frame* parent, nbt_t* tag, bool kept) {
+	if (parent->tag->type == NBT_COMPOUND) {
+		if (kept) {
+			nbt_compound_set(parent->tag, tag);
+		} else {
+			nbt_release(tag);
+		}
+	} else {
+		/* Lists keep every element, even empty ones, so indices still line up */
+		nbt_list_add(parent->tag, tag);
+	}
+	parent->kept |= kept;
+}
+
+/* NULL if nothing under tag is on a path, the caller drops it. Iterative like _nbt_parse_payload, so deep input can't run out of stack */
+nbt_t* _nbt_parse_projected(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	struct nbt_projected_frame inline_frames[NBT_PROJECTED_INLINE_DEPTH];
+	struct nbt_projected_frame* frames = inline_frames;
+	size_t reserved = NBT_PROJECTED_INLINE_DEPTH;
+	size_t depth = 0;
+	nbt_t* node = tag;
+	const nbt_projection_t* projection = context->options.projection;
+	nbt_t* result = NULL;
+	while (node) {
+		struct nbt_projected_frame frame = { node, projection, 0, false };
+		bool kept;
+		if (_nbt_parse_projected_value(node, coder, order, context, &frame, &kept)) {
+			if (depth == reserved) {
+				struct nbt_projected_frame* grown = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				if (!grown) {
+					context->status = NBT_ERROR_MEMORY;
+					if (depth) {
+						nbt_release(node);
+					}
+					break;
+				}
+				frames = grown;
+			}
+			frames[depth++] = frame;
+		} else if (depth) {
+			_nbt_parse_projected_link(&frames[depth - 1], node, kept);
+		} else if (kept) {
+			result = tag;
+		}
+		
+		/* The next child on a path of the innermost container that has one left, closing the ones that are done */
+		node = NULL;
+		while (depth && !node && !context->status) {
+			struct nbt_projected_frame* top = &frames[depth - 1];
+			if (top->tag->type == NBT_COMPOUND) {
+				nbt_type_t type = nbt_coder_decode_byte(coder);
+				if (type != NBT_END) {
+					uint16_t name_length = nbt_coder_decode_short(coder, order);
+					char* name = _nbt_context_scratch(&context->name, &context->name_reserved, name_length);
+					nbt_coder_decode_data(coder, name, name_length);
+					const nbt_projection_t* child = _nbt_projection_child(top->projection, name, name_length);
+					if (!child || (!child->whole && type != NBT_COMPOUND && type != NBT_LIST)) {
+						/* Off every path, no node at all */
+						_nbt_skip_payload(coder, type, order);
+						continue;
+					}
+					/* Charged like any other node, see _nbt_parse_header */
+					if (!_nbt_parse_spend(context, sizeof(nbt_t) + (name_length < NBT_INLINE_NAME ? 0 : name_length + 1))) {
+						break;
+					}
+					node = _nbt_create_in(context->arena, type, NULL, 0);
+					_nbt_parse_name(node, name, name_length, context);
+					projection = child;
+					continue;
+				}
+			} else if (top->remaining > 0) {
+				/* The same path for every element */
+				top->remaining--;
+				node = _nbt_create_in(context->arena, top->tag->element_type, NULL, 0);
+				projection = top->projection;
+				continue;
+			}
+			/* The root is always there, even if nothing matched */
+			struct nbt_projected_frame done = frames[--depth];
+			if (depth) {
+				_nbt_parse_projected_link(&frames[depth - 1], done.tag, done.kept);
+			} else {
+				result = tag;
+			}
+		}
+	}
+	if (context->status) {
+		/* Whatever's still open hasn't been linked into anything, apart from the root, which is the caller's */
+		for (size_t i = 1; i < depth; i++) {
+			nbt_release(frames[i].tag);
+		}
+		result = NULL;
+	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+	return result;
+}
@@ -0,0 +1,398 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  reader.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* Arrays are decoded a piece at a time, so a stream's window always holds the next piece */
+#define NBT_READER_CHUNK (16 * 1024)
+
+struct nbt_reader_frame {
+	bool compound;
+	bool ended;	/* a compound's END has been read */
+	nbt_type_t element_type;
+	int32_t count;
+	int32_t next;	/* the next element's index */
+};
+
+struct nbt_reader {
+	nbt_coder_t* coder;
+	nbt_byte_order_t order;
+	nbt_status_t status;
+	
+	struct nbt_reader_frame* frames;
+	size_t depth;
+	size_t reserved;
+	
+	bool started;	/* the root's header has been read */
+	bool pending;	/* the current tag's payload hasn't been read, skipped or entered */
+	nbt_type_t type;
+	char* name;
+	size_t name_reserved;
+};
+
+bool _nbt_reader_fail(nbt_reader_t* reader);
+bool _nbt_reader_need(nbt_reader_t* reader, size_t length);
+bool _nbt_reader_skip_bytes(nbt_reader_t* reader, size_t length);
+bool _nbt_reader_skip_value(nbt_reader_t* reader);
+bool _nbt_reader_close(nbt_reader_t* reader, size_t depth);
+bool _nbt_reader_value(nbt_reader_t* reader, nbt_type_t type, size_t length);
+
+nbt_reader_t* nbt_reader_create(nbt_coder_t* coder, nbt_byte_order_t order) {
+	nbt_reader_t* reader = malloc(sizeof(*reader));
+	memset(reader, 0, sizeof(*reader));
+	nbt_reader_reset(reader, coder, order);
+	return reader;
+}
+
+void nbt_reader_reset(nbt_reader_t* reader, nbt_coder_t* coder, nbt_byte_order_t order) {
+	/* Keeps the stack and the name buffer */
+	reader->coder = coder;
+	reader->order = order;
+	reader->status = NBT_SUCCESS;
+	reader->depth = 0;
+	reader->started = false;
+	reader->pending = false;
+}
+
+void nbt_reader_release(nbt_reader_t* reader) {
+	if (reader) {
+		free(reader->frames);
+		free(reader->name);
+		free(reader);
+	}
+}
+
+nbt_status_t nbt_reader_status(nbt_reader_t* reader) {
+	return reader->status;
+}
+
+bool nbt_reader_next(nbt_reader_t* reader, nbt_reader_tag_t* tag) {
+	if (reader->status || (reader->pending && !nbt_reader_skip(reader))) {
+		return false;
+	}
+	nbt_type_t type;
+	int32_t index = 0;
+	bool named = true;
+	if (!reader->depth) {
+		if (reader->started || !_nbt_reader_need(reader, sizeof(int8_t))) {
+			return false;
+		}
+		reader->started = true;
+		type = nbt_coder_decode_byte(reader->coder);
+		if (type == NBT_END) {
+			return false;
+		}
+	} else {
+		struct nbt_reader_frame* frame = &reader->frames[reader->depth - 1];
+		if (frame->compound) {
+			if (frame->ended || !_nbt_reader_need(reader, sizeof(int8_t))) {
+				return false;
+			}
+			type = nbt_coder_decode_byte(reader->coder);
+			if (type == NBT_END) {
+				frame->ended = true;
+				return false;
+			}
+		} else {
+			if (frame->next == frame->count) {
+				return false;
+			}
+			type = frame->element_type;
+			index = frame->next++;
+			named = false;
+		}
+	}
+	if (type < NBT_BYTE || type > NBT_LONG_ARRAY) {
+		return _nbt_reader_fail(reader);
+	}
+	
+	uint16_t name_length = 0;
+	if (named) {
+		if (!_nbt_reader_need(reader, sizeof(int16_t))) {
+			return false;
+		}
+		name_length = nbt_coder_decode_short(reader->coder, reader->order);
+		if (!_nbt_reader_need(reader, name_length)) {
+			return false;
+		}
+		char* name = _nbt_context_scratch(&reader->name, &reader->name_reserved, name_length + 1);
+		nbt_coder_decode_data(reader->coder, name, name_length);
+		name[name_length] = '\0';
+	}
+	reader->type = type;
+	reader->pending = true;
+	if (tag) {
+		tag->type = type;
+		tag->name = named ? reader->name : NULL;
+		tag->name_length = name_length;
+		tag->index = index;
+		tag->depth = reader->depth;
+	}
+	return true;
+}
+
+bool nbt_reader_skip(nbt_reader_t* reader) {
+	if (reader->status) {
+		return false;
+	}
+	assert(reader->pending);
+	if (reader->type != NBT_COMPOUND && reader->type != NBT_LIST) {
+		return _nbt_reader_skip_value(reader);
+	}
+	/* Containers are skipped from the inside, on the reader's own stack */
+	size_t depth = reader->depth;
+	return nbt_reader_enter(reader, NULL, NULL) && _nbt_reader_close(reader, depth);
+}
+
+bool nbt_reader_enter(nbt_reader_t* reader, nbt_type_t* element_type, int32_t* count) {
+	if (reader->status) {
+		return false;
+	}
+	assert(reader->pending && (reader->type == NBT_COMPOUND || reader->type == NBT_LIST));
+	reader->pending = false;
+	struct nbt_reader_frame frame = { reader->type == NBT_COMPOUND, false, NBT_END, 0, 0 };
+	if (!frame.compound) {
+		if (!_nbt_reader_need(reader, sizeof(int8_t) + sizeof(int32_t))) {
+			return false;
+		}
+		frame.element_type = nbt_coder_decode_byte(reader->coder);
+		frame.count = nbt_coder_decode_int(reader->coder, reader->order);
+		/* Empty lists are allowed to say END */
+		bool empty = frame.count == 0 && frame.element_type == NBT_END;
+		if (frame.count < 0 || (!empty && (frame.element_type < NBT_BYTE || frame.element_type > NBT_LONG_ARRAY))) {
+			return _nbt_reader_fail(reader);
+		}
+		if (element_type) {
+			*element_type = frame.element_type;
+		}
+		if (count) {
+			*count = frame.count;
+		}
+	}
+	if (reader->depth == reader->reserved) {
+		struct nbt_reader_frame* grown = _nbt_frames_grow(reader->frames, NULL, &reader->reserved, sizeof(*reader->frames));
+		if (!grown) {
+			reader->status = NBT_ERROR_MEMORY;
+			return false;
+		}
+		reader->frames = grown;
+	}
+	reader->frames[reader->depth++] = frame;
+	return true;
+}
+
+bool nbt_reader_leave(nbt_reader_t* reader) {
+	if (reader->status) {
+		return false;
+	}
+	assert(reader->depth);
+	return _nbt_reader_close(reader, reader->depth - 1);
+}
+
+/* Skip to the end of every container deeper than depth, without recursing */
+bool _nbt_reader_close(nbt_reader_t* reader, size_t depth) {
+	while (reader->depth > depth) {
+		struct nbt_reader_frame* frame = &reader->frames[reader->depth - 1];
+		size_t width = frame->compound ? 0 : _nbt_packed_width(frame->element_type);
+		if (reader->pending) {
+			if (reader->type == NBT_COMPOUND || reader->type == NBT_LIST) {
+				if (!nbt_reader_enter(reader, NULL, NULL)) {
+					return false;
+				}
+			} else if (!_nbt_reader_skip_value(reader)) {
+				return false;
+			}
+		} else if (width && frame->next < frame->count) {
+			/* The rest of a list of numbers in one go */
+			if (!_nbt_reader_skip_bytes(reader, width * (frame->count - frame->next))) {
+				return false;
+			}
+			frame->next = frame->count;
+		} else if (!nbt_reader_next(reader, NULL)) {
+			if (reader->status) {
+				return false;
+			}
+			reader->depth--;
+		}
+	}
+	return true;
+}
+
+bool nbt_reader_read_byte(nbt_reader_t* reader, int8_t* value) {
+	if (!_nbt_reader_value(reader, NBT_BYTE, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_byte(reader->coder);
+	return true;
+}
+
+bool nbt_reader_read_short(nbt_reader_t* reader, int16_t* value) {
+	if (!_nbt_reader_value(reader, NBT_SHORT, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_short(reader->coder, reader->order);
+	return true;
+}
+
+bool nbt_reader_read_int(nbt_reader_t* reader, int32_t* value) {
+	if (!_nbt_reader_value(reader, NBT_INT, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_int(reader->coder, reader->order);
+	return true;
+}
+
+bool nbt_reader_read_long(nbt_reader_t* reader, int64_t* value) {
+	if (!_nbt_reader_value(reader, NBT_LONG, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_long(reader->coder, reader->order);
+	return true;
+}
+
+bool nbt_reader_read_float(nbt_reader_t* reader, float* value) {
+	if (!_nbt_reader_value(reader, NBT_FLOAT, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_float(reader->coder, reader->order);
+	return true;
+}
+
+bool nbt_reader_read_double(nbt_reader_t* reader, double* value) {
+	if (!_nbt_reader_value(reader, NBT_DOUBLE, sizeof(*value))) {
+		return false;
+	}
+	*value = nbt_coder_decode_double(reader->coder, reader->order);
+	return true;
+}
+
+bool nbt_reader_read_string_view(nbt_reader_t* reader, const char** bytes, uint16_t* length) {
+	if (!_nbt_reader_value(reader, NBT_STRING, sizeof(*length))) {
+		return false;
+	}
+	*length = nbt_coder_decode_short(reader->coder, reader->order);
+	if (!_nbt_reader_need(reader, *length)) {
+		return false;
+	}
+	*bytes = nbt_coder_data(reader->coder) + _nbt_coder_tell(reader->coder);
+	_nbt_coder_skip(reader->coder, *length);
+	return true;
+}
+
+bool nbt_reader_read_array(nbt_reader_t* reader, void* elements, int32_t capacity, int32_t* length) {
+	if (reader->status) {
+		return false;
+	}
+	nbt_type_t type = reader->type;
+	assert(reader->pending && (type == NBT_BYTE_ARRAY || type == NBT_INT_ARRAY || type == NBT_LONG_ARRAY));
+	if (!_nbt_reader_value(reader, type, sizeof(int32_t))) {
+		return false;
+	}
+	*length = nbt_coder_decode_int(reader->coder, reader->order);
+	if (*length < 0) {
+		return _nbt_reader_fail(reader);
+	}
+	size_t width = type == NBT_BYTE_ARRAY ? sizeof(int8_t) : type == NBT_INT_ARRAY ? sizeof(int32_t) : sizeof(int64_t);
+	size_t wanted = capacity < *length ? (capacity > 0 ? capacity : 0) : *length;
+	char* buffer = elements;
+	for (size_t done = 0; done < wanted;) {
+		size_t count = wanted - done < NBT_READER_CHUNK / width ? wanted - done : NBT_READER_CHUNK / width;
+		if (!_nbt_reader_need(reader, width * count)) {
+			return false;
+		}
+		switch (type) {
+			case NBT_BYTE_ARRAY:
+				nbt_coder_decode_data(reader->coder, buffer, count);
+				break;
+			case NBT_INT_ARRAY:
+				nbt_coder_decode_ints(reader->coder, (int32_t*)buffer, count, reader->order);
+				break;
+			default:
+				nbt_coder_decode_longs(reader->coder, (int64_t*)buffer, count, reader->order);
+				break;
+		}
+		buffer += width * count;
+		done += count;
+	}
+	return _nbt_reader_skip_bytes(reader, width * (*length - wanted));
+}
+
+bool _nbt_reader_fail(nbt_reader_t* reader) {
+	reader->status = NBT_ERROR_FORMAT;
+	return false;
+}
+
+bool _nbt_reader_need(nbt_reader_t* reader, size_t length) {
+	return _nbt_coder_ensure(reader->coder, length) || _nbt_reader_fail(reader);
+}
+
+bool _nbt_reader_skip_bytes(nbt_reader_t* reader, size_t length) {
+	return _nbt_coder_skip_checked(reader->coder, length) || _nbt_reader_fail(reader);
+}
+
+/* Past the current payload, which isn't a container */
+bool _nbt_reader_skip_value(nbt_reader_t* reader) {
+	reader->pending = false;
+	size_t length;
+	switch (reader->type) {
+		case NBT_STRING:
+			if (!_nbt_reader_need(reader, sizeof(int16_t))) {
+				return false;
+			}
+			length = (uint16_t)nbt_coder_decode_short(reader->coder, reader->order);
+			break;
+		case NBT_BYTE_ARRAY:
+		case NBT_INT_ARRAY:
+		case NBT_LONG_ARRAY: {
+			if (!_nbt_reader_need(reader, sizeof(int32_t))) {
+				return false;
+			}
+			int32_t count = nbt_coder_decode_int(reader->coder, reader->order);
+			if (count < 0) {
+				return _nbt_reader_fail(reader);
+			}
+			length = (reader->type == NBT_BYTE_ARRAY ? sizeof(int8_t) : reader->type == NBT_INT_ARRAY ? sizeof(int32_t) : sizeof(int64_t)) * count;
+			break;
+		}
+		default:
+			length = _nbt_packed_width(reader->type);
+			break;
+	}
+	return _nbt_reader_skip_bytes(reader, length);
+}
+
+/* Ready to decode length bytes of the current payload, which has to be of type */
+bool _nbt_reader_value(nbt_reader_t* reader, nbt_type_t type, size_t length) {
+	if (reader->status) {
+		return false;
+	}
+	assert(reader->pending && reader->type == type);
+	reader->pending = false;
+	return _nbt_reader_need(reader, length);
+}
@@ -0,0 +1,282 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  split.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "internal.h"
+#include "coder.h"
+#include "parallel.h"
+
+/* Anything smaller isn't worth the threads */
+#define NBT_SPLIT_MIN (256 * 1024)
+
+/* The smallest run of elements a thread gets, and how many runs there are per thread at most */
+#define NBT_SPLIT_CHUNK (16 * 1024)
+#define NBT_SPLIT_CHUNKS_PER_THREAD 8
+
+/* Children are split up themselves this many levels down at most */
+#define NBT_SPLIT_DEPTH 8
+
+/* A tag one worker decodes on its own, or a container the plan already made */
+struct nbt_split_unit {
+	nbt_t* parent;
+	nbt_t* tag;
+	size_t offset;	/* of the named tag in a compound, or of the payload in a list */
+	size_t length;
+};
+
+/* A run of units in input order and what decoding it came to */
+struct nbt_split_chunk {
+	size_t first;
+	size_t last;
+	nbt_arena_t* arena;
+	nbt_status_t status;
+};
+
+struct nbt_split {
+	nbt_context_t* context;
+	nbt_byte_order_t order;
+	const char* data;
+	size_t size;
+	size_t chunk;	/* bytes a run is aimed at, and what a child has to come to for it to be split too */
+	size_t budget;	/* what's left of the context's, every worker of a limited parse spends from it */
+	
+	struct nbt_split_unit* units;
+	size_t count;
+	size_t reserved;
+	
+	struct nbt_split_chunk* chunks;
+};
+
+bool _nbt_split_container(struct nbt_split* split, nbt_type_t type, size_t payload);
+void _nbt_split_plan(struct nbt_split* split, nbt_t* tag, nbt_coder_t* coder, size_t depth);
+void _nbt_split_add(struct nbt_split* split, nbt_t* parent, nbt_t* tag, size_t offset, size_t length);
+void _nbt_split_decode(void* context, size_t index);
+
+nbt_t* _nbt_parse_split(nbt_coder_t* coder, nbt_byte_order_t order, nbt_context_t* context) {
+	size_t threads = context->options.threads ? context->options.threads : _nbt_parallel_threads();
+	if (threads < 2) {
+		return _nbt_parse_coder(coder, order, context);
+	}
+	if (!_nbt_coder_whole(coder)) {
+		/* The workers need all of it at once */
+		if (context->inflated) {
+			nbt_coder_reset(context->inflated);
+		} else {
+			context->inflated = nbt_coder_create();
+		}
+		_nbt_coder_drain_into(coder, context->inflated, 0);
+		coder = context->inflated;
+	}
+	struct nbt_split split = {
+		.context	= context,
+		.order		= order,
+		.data		= nbt_coder_data(coder),
+		.size		= nbt_coder_size(coder)
+	};
+	nbt_t* root = _nbt_parse_header(coder, order, context);
+	if (!root) {
+		return NULL;
+	}
+	size_t payload = _nbt_coder_tell(coder);
+	if (split.size - payload < NBT_SPLIT_MIN || !_nbt_split_container(&split, root->type, payload)) {
+		return _nbt_parse_child(root, coder, order, context);
+	}
+	split.chunk = (split.size - payload) / (threads * NBT_SPLIT_CHUNKS_PER_THREAD);
+	if (split.chunk < NBT_SPLIT_CHUNK) {
+		split.chunk = NBT_SPLIT_CHUNK;
+	}
+	
+	/* Where everything starts, making the containers that get split up as it goes */
+	_nbt_split_plan(&split, root, coder, 0);
+	
+	if (!context->status) {
+		/* Runs of about split.chunk bytes, a unit that's bigger on its own gets one to itself */
+		size_t count = 0;
+		split.chunks = malloc(sizeof(*split.chunks) * (split.count ? split.count : 1));
+		for (size_t i = 0; i < split.count;) {
+			struct nbt_split_chunk* chunk = &split.chunks[count++];
+			memset(chunk, 0, sizeof(*chunk));
+			chunk->first = i;
+			size_t length = 0;
+			while (i < split.count && (length < split.chunk || i == chunk->first)) {
+				length += split.units[i++].length;
+			}
+			chunk->last = i;
+		}
+		split.budget = context->budget;
+		_nbt_parallel_for(count, threads, _nbt_split_decode, &split);
+		context->budget = split.budget;
+		
+		for (size_t i = 0; i < count; i++) {
+			struct nbt_split_chunk* chunk = &split.chunks[i];
+			if (chunk->arena) {
+				_nbt_arena_adopt(context->arena, chunk->arena);
+			}
+			if (chunk->status) {
+				context->status = chunk->status;
+			}
+		}
+		free(split.chunks);
+	}
+	
+	/* In input order, and containers only once everything in them is, just like a plain parse */
+	for (size_t i = 0; i < split.count; i++) {
+		struct nbt_split_unit* unit = &split.units[i];
+		if (!unit->tag) {
+			continue;
+		}
+		if (unit->parent->type == NBT_LIST) {
+			nbt_list_add(unit->parent, unit->tag);
+		} else {
+			nbt_compound_set(unit->parent, unit->tag);
+		}
+	}
+	free(split.units);
+	return root;
+}
+
+/* Compounds and lists of anything that isn't packed, the rest are one piece however big they are */
+bool _nbt_split_container(struct nbt_split* split, nbt_type_t type, size_t payload) {
+	if (type == NBT_COMPOUND) {
+		return true;
+	}
+	if (type != NBT_LIST || payload >= split->size) {
+		return false;
+	}
+	nbt_type_t element_type = split->data[payload];
+	return element_type != NBT_END && !_nbt_packed_width(element_type);
+}
+
+/* The coder is at the start of tag's payload, and is left at its end */
+void _nbt_split_plan(struct nbt_split* split, nbt_t* tag, nbt_coder_t* coder, size_t depth) {
+	nbt_context_t* context = split->context;
+	nbt_byte_order_t order = split->order;
+	if (tag->type == NBT_LIST) {
+		/* What a plain parse does up to the elements */
+		nbt_type_t list_type = nbt_coder_decode_byte(coder);
+		tag->element_type = list_type;
+		int32_t count = nbt_coder_decode_int(coder, order);
+		if (count > 0 && !_nbt_parse_spend(context, (sizeof(nbt_t) + sizeof(nbt_t*)) * (size_t)count)) {
+			return;
+		}
+		_nbt_list_reserve(tag, _nbt_parse_reserve(coder, count));
+		for (int32_t i = 0; i < count && !context->status; i++) {
+			size_t offset = _nbt_coder_tell(coder);
+			_nbt_skip_payload(coder, list_type, order);
+			size_t length = _nbt_coder_tell(coder) - offset;
+			if (length > split->chunk && depth < NBT_SPLIT_DEPTH && _nbt_split_container(split, list_type, offset)) {
+				_nbt_coder_seek(coder, offset);
+				nbt_t* item = _nbt_create_in(context->arena, list_type, NULL, 0);
+				_nbt_split_plan(split, item, coder, depth + 1);
+				_nbt_split_add(split, tag, item, offset, 0);
+			} else {
+				_nbt_split_add(split, tag, NULL, offset, length);
+			}
+		}
+		return;
+	}
+	while (!context->status) {
+		size_t offset = _nbt_coder_tell(coder);
+		nbt_type_t type = nbt_coder_decode_byte(coder);
+		if (type == NBT_END) {
+			break;
+		}
+		_nbt_coder_skip(coder, (uint16_t)nbt_coder_decode_short(coder, order));
+		size_t payload = _nbt_coder_tell(coder);
+		_nbt_skip_payload(coder, type, order);
+		size_t length = _nbt_coder_tell(coder) - offset;
+		if (length > split->chunk && depth < NBT_SPLIT_DEPTH && _nbt_split_container(split, type, payload)) {
+			_nbt_coder_seek(coder, offset);
+			nbt_t* child = _nbt_parse_header(coder, order, context);
+			if (!child) {
+				break;
+			}
+			_nbt_split_plan(split, child, coder, depth + 1);
+			_nbt_split_add(split, tag, child, offset, 0);
+		} else {
+			_nbt_split_add(split, tag, NULL, offset, length);
+		}
+	}
+}
+
+void _nbt_split_add(struct nbt_split* split, nbt_t* parent, nbt_t* tag, size_t offset, size_t length) {
+	if (split->count == split->reserved) {
+		split->reserved = split->reserved ? split->reserved * 2 : 256;
+		split->units = realloc(split->units, sizeof(*split->units) * split->reserved);
+	}
+	split->units[split->count++] = (struct nbt_split_unit){ parent, tag, offset, length };
+}
+
+/* One run, with a context and arena of its own */
+void _nbt_split_decode(void* context, size_t index) {
+	struct nbt_split* split = context;
+	struct nbt_split_chunk* chunk = &split->chunks[index];
+	nbt_context_t local;
+	_nbt_context_init(&local);
+	nbt_context_set_options(&local, &split->context->options);
+	if (split->context->budget != SIZE_MAX) {
+		/* One budget for all of them, so the first to run it dry stops the rest */
+		local.shared_budget = &split->budget;
+	}
+	if (split->context->arena) {
+		local.arena = chunk->arena = _nbt_arena_create();
+	}
+	nbt_coder_t* coder = nbt_coder_create_borrowed(split->data, split->size);
+	for (size_t i = chunk->first; i < chunk->last && !local.status; i++) {
+		struct nbt_split_unit* unit = &split->units[i];
+		if (unit->tag) {
+			continue;
+		}
+		_nbt_coder_seek(coder, unit->offset);
+		if (unit->parent->type == NBT_LIST) {
+			nbt_t* item = _nbt_create_in(local.arena, unit->parent->element_type, NULL, 0);
+			unit->tag = _nbt_parse_child(item, coder, split->order, &local);
+		} else {
+			unit->tag = _nbt_parse_coder(coder, split->order, &local);
+		}
+	}
+	chunk->status = local.status;
+	nbt_coder_release(coder);
+	/* The arena is the chunk's to hand over */
+	local.arena = NULL;
+	_nbt_context_clear(&local);
+}
+
+bool _nbt_parse_spend_shared(nbt_context_t* context, size_t bytes) {
+	size_t budget = __atomic_load_n(context->shared_budget, __ATOMIC_RELAXED);
+	do {
+		if (bytes > budget) {
+			/* Nothing left for anyone, so the other workers stop at their next spend too */
+			__atomic_store_n(context->shared_budget, 0, __ATOMIC_RELAXED);
+			context->status = NBT_ERROR_LIMIT;
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(context->shared_budget, &budget, budget - bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return true;
+}
@@ -0,0 +1,235 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  validate.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* Minecraft's own nesting limit, anything deeper moves the stack to the heap */
+#define NBT_VALIDATE_INLINE_DEPTH 512
+
+/* An open container, a compound runs until its END and a list for its count */
+struct nbt_validate_frame {
+	bool compound;
+	nbt_type_t element_type;
+	int32_t remaining;
+};
+
+/* Reads straight out of the buffer, every read is bounds checked first */
+struct nbt_validator {
+	const uint8_t* cursor;
+	const uint8_t* end;
+	nbt_byte_order_t order;
+	nbt_status_t status;
+	const uint8_t* failed;	/* where the problem is */
+};
+
+bool _nbt_validate_fail(struct nbt_validator* validator, nbt_status_t status, const uint8_t* at);
+bool _nbt_validate_skip(struct nbt_validator* validator, uint64_t length);
+
+static inline bool _nbt_validate_need(struct nbt_validator* validator, size_t length) {
+	return (size_t)(validator->end - validator->cursor) >= length || _nbt_validate_fail(validator, NBT_ERROR_FORMAT, validator->cursor);
+}
+
+static inline bool _nbt_validate_type(nbt_type_t type) {
+	return type >= NBT_BYTE && type <= NBT_LONG_ARRAY;
+}
+
+/* By hand rather than through nbt_reorder_*, so they inline into the loop */
+static inline uint16_t _nbt_validate_short(struct nbt_validator* validator) {
+	const uint8_t* bytes = validator->cursor;
+	validator->cursor += sizeof(int16_t);
+	return validator->order == NBT_BIG_ENDIAN ? (uint16_t)(bytes[0] << 8 | bytes[1]) : (uint16_t)(bytes[1] << 8 | bytes[0]);
+}
+
+static inline int32_t _nbt_validate_int(struct nbt_validator* validator) {
+	const uint8_t* bytes = validator->cursor;
+	validator->cursor += sizeof(int32_t);
+	if (validator->order == NBT_BIG_ENDIAN) {
+		return (int32_t)((uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3]);
+	}
+	return (int32_t)((uint32_t)bytes[3] << 24 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0]);
+}
+
+nbt_status_t nbt_validate(const char* bytes, size_t length, nbt_byte_order_t order, const nbt_limits_t* limits, size_t* offset) {
+	struct nbt_validator validator = { (const uint8_t*)bytes, (const uint8_t*)bytes + length, order, NBT_SUCCESS, NULL };
+	size_t max_depth = limits && limits->depth ? limits->depth : SIZE_MAX;
+	size_t max_tags = limits && limits->tags ? limits->tags : SIZE_MAX;
+	struct nbt_validate_frame inline_frames[NBT_VALIDATE_INLINE_DEPTH];
+	struct nbt_validate_frame* frames = inline_frames;
+	size_t reserved = NBT_VALIDATE_INLINE_DEPTH;
+	size_t depth = 0;
+	size_t tags = 0;
+	
+	/* The root's header, there has to be one */
+	nbt_type_t type = NBT_END;
+	if (_nbt_validate_need(&validator, sizeof(int8_t))) {
+		type = *validator.cursor;
+		if (!_nbt_validate_type(type)) {
+			_nbt_validate_fail(&validator, NBT_ERROR_FORMAT, validator.cursor);
+		} else if (validator.cursor++, _nbt_validate_need(&validator, sizeof(int16_t))) {
+			_nbt_validate_skip(&validator, _nbt_validate_short(&validator));
+		}
+	}
+	
+	while (!validator.status) {
+		const uint8_t* payload = validator.cursor;
+		if (++tags > max_tags) {
+			_nbt_validate_fail(&validator, NBT_ERROR_LIMIT, payload);
+			break;
+		}
+		struct nbt_validate_frame frame = { false, NBT_END, 0 };
+		bool open = false;
+		switch (type) {
+			case NBT_BYTE_ARRAY:
+			case NBT_INT_ARRAY:
+			case NBT_LONG_ARRAY: {
+				if (!_nbt_validate_need(&validator, sizeof(int32_t))) {
+					break;
+				}
+				int32_t count = _nbt_validate_int(&validator);
+				size_t width = type == NBT_BYTE_ARRAY ? sizeof(int8_t) : type == NBT_INT_ARRAY ? sizeof(int32_t) : sizeof(int64_t);
+				if (count < 0) {
+					_nbt_validate_fail(&validator, NBT_ERROR_FORMAT, payload);
+				} else {
+					_nbt_validate_skip(&validator, (uint64_t)width * count);
+				}
+				break;
+			}
+			case NBT_STRING:
+				if (_nbt_validate_need(&validator, sizeof(int16_t))) {
+					_nbt_validate_skip(&validator, _nbt_validate_short(&validator));
+				}
+				break;
+			case NBT_LIST: {
+				if (!_nbt_validate_need(&validator, sizeof(int8_t) + sizeof(int32_t))) {
+					break;
+				}
+				frame.element_type = *validator.cursor++;
+				frame.remaining = _nbt_validate_int(&validator);
+				open = true;
+				/* Empty lists are allowed to say END */
+				bool empty = frame.remaining == 0 && frame.element_type == NBT_END;
+				if (frame.remaining < 0 || (!empty && !_nbt_validate_type(frame.element_type))) {
+					_nbt_validate_fail(&validator, NBT_ERROR_FORMAT, payload);
+					break;
+				}
+				size_t width = _nbt_packed_width(frame.element_type);
+				if (width && frame.remaining) {
+					/* count x width, no need to look at the elements, though they're still tags */
+					if ((size_t)frame.remaining > max_tags - tags) {
+						_nbt_validate_fail(&validator, NBT_ERROR_LIMIT, payload);
+						break;
+					}
+					tags += frame.remaining;
+					_nbt_validate_skip(&validator, (uint64_t)width * frame.remaining);
+					frame.remaining = 0;
+				}
+				break;
+			}
+			case NBT_COMPOUND:
+				frame.compound = true;
+				open = true;
+				break;
+			default:
+				_nbt_validate_skip(&validator, _nbt_packed_width(type));
+				break;
+		}
+		if (validator.status) {
+			break;
+		}
+		if (open && depth + 1 > max_depth) {
+			_nbt_validate_fail(&validator, NBT_ERROR_LIMIT, payload);
+			break;
+		}
+		if (frame.compound || frame.remaining > 0) {
+			if (depth == reserved) {
+				struct nbt_validate_frame* grown = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				if (!grown) {
+					_nbt_validate_fail(&validator, NBT_ERROR_MEMORY, payload);
+					break;
+				}
+				frames = grown;
+			}
+			frames[depth++] = frame;
+		}
+		
+		/* The next payload of the innermost container that has one left */
+		type = NBT_END;
+		while (depth && type == NBT_END && !validator.status) {
+			struct nbt_validate_frame* top = &frames[depth - 1];
+			if (top->compound) {
+				if (!_nbt_validate_need(&validator, sizeof(int8_t))) {
+					break;
+				}
+				type = *validator.cursor;
+				if (type != NBT_END) {
+					if (!_nbt_validate_type(type)) {
+						_nbt_validate_fail(&validator, NBT_ERROR_FORMAT, validator.cursor);
+						break;
+					}
+					validator.cursor++;
+					if (_nbt_validate_need(&validator, sizeof(int16_t))) {
+						_nbt_validate_skip(&validator, _nbt_validate_short(&validator));
+					}
+					continue;
+				}
+				validator.cursor++;
+			} else if (top->remaining > 0) {
+				top->remaining--;
+				type = top->element_type;
+				continue;
+			}
+			depth--;
+		}
+		if (type == NBT_END) {
+			break;
+		}
+	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+	if (offset) {
+		*offset = (const char*)(validator.status ? validator.failed : validator.cursor) - bytes;
+	}
+	return validator.status;
+}
+
+bool _nbt_validate_fail(struct nbt_validator* validator, nbt_status_t status, const uint8_t* at) {
+	validator->status = status;
+	validator->failed = at;
+	return false;
+}
+
+/* A length that came out of the input, so it's checked before anything moves */
+bool _nbt_validate_skip(struct nbt_validator* validator, uint64_t length) {
+	if (length > (uint64_t)(validator->end - validator->cursor)) {
+		return _nbt_validate_fail(validator, NBT_ERROR_FORMAT, validator->cursor);
+	}
+	validator->cursor += length;
+	return true;
+}
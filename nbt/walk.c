@@ -0,0 +1,165 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  walk.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "internal.h"
+
+/* Deeper walks move their stack to the heap */
+#define NBT_WALK_INLINE_DEPTH 32
+
+struct nbt_walk_frame {
+	nbt_t* container;
+	nbt_walk_position_t position;	/* the container's own */
+	nbt_t* next;	/* compounds: the next child, taken before the current one is visited */
+	int32_t index;	/* the next child's index */
+};
+
+bool _nbt_walk_descends(nbt_t* tag, nbt_walk_flags_t flags);
+
+bool nbt_walk(nbt_t* tag, nbt_visitor_t pre, nbt_visitor_t post, void* context) {
+	return _nbt_walk(tag, pre, post, context, NBT_WALK_PACKED_ELEMENTS);
+}
+
+bool _nbt_walk(nbt_t* tag, nbt_visitor_t pre, nbt_visitor_t post, void* context, nbt_walk_flags_t flags) {
+	struct nbt_walk_frame inline_frames[NBT_WALK_INLINE_DEPTH];
+	struct nbt_walk_frame* frames = inline_frames;
+	size_t reserved = NBT_WALK_INLINE_DEPTH;
+	size_t depth = 0;
+	bool stopped = false;
+	nbt_t scratch;
+	nbt_walk_position_t position = { NULL, 0, true, 0 };
+	nbt_t* node = tag;
+	while (node) {
+		if (node->flags & NBT_FLAG_DEFERRED && !(flags & NBT_WALK_DEFERRED)) {
+			_nbt_materialize(node);
+		}
+		nbt_walk_action_t action = pre ? pre(node, &position, context) : NBT_WALK_CONTINUE;
+		if (action == NBT_WALK_STOP) {
+			stopped = true;
+			break;
+		}
+		if (action != NBT_WALK_SKIP && _nbt_walk_descends(node, flags)) {
+			if (depth == reserved) {
+				struct nbt_walk_frame* grown = _nbt_frames_grow(frames, inline_frames, &reserved, sizeof(*frames));
+				if (!grown) {
+					/* No room to go any deeper, which stops the walk like a visitor would */
+					stopped = true;
+					break;
+				}
+				frames = grown;
+			}
+			struct nbt_walk_frame* frame = &frames[depth++];
+			frame->container = node;
+			frame->position = position;
+			frame->next = node->type == NBT_COMPOUND ? node->payload.tag_compound.head : NULL;
+			frame->index = 0;
+		} else if (post && post(node, &position, context) == NBT_WALK_STOP) {
+			stopped = true;
+			break;
+		}
+		
+		/* On to the next child of the innermost container that has one left */
+		node = NULL;
+		while (depth && !node) {
+			struct nbt_walk_frame* frame = &frames[depth - 1];
+			nbt_t* container = frame->container;
+			if (container->type == NBT_COMPOUND) {
+				if (frame->next) {
+					node = frame->next;
+					/* Taken now so post can release node, and fetched while node is visited */
+					frame->next = node->tree_right;
+					if (frame->next) {
+						_nbt_prefetch(frame->next);
+					}
+				}
+			} else {
+				struct nbt_list* list = &container->payload.tag_list;
+				if (frame->index < list->count) {
+					node = _nbt_list_element(container, frame->index, &scratch);
+					if (!(container->flags & NBT_FLAG_PACKED) && frame->index + 1 < list->count) {
+						_nbt_prefetch(list->elements.items[frame->index + 1]);
+					}
+				}
+			}
+			if (node) {
+				position.parent = container;
+				position.index = frame->index++;
+				position.last = container->type == NBT_COMPOUND ? !frame->next : frame->index == container->payload.tag_list.count;
+				position.depth = depth;
+			} else {
+				depth--;
+				if (post && post(container, &frame->position, context) == NBT_WALK_STOP) {
+					stopped = true;
+					break;
+				}
+			}
+		}
+		if (stopped) {
+			break;
+		}
+	}
+	if (frames != inline_frames) {
+		free(frames);
+	}
+	return !stopped;
+}
+
+void* _nbt_frames_grow(void* frames, const void* inline_frames, size_t* reserved, size_t size) {
+	size_t grown = *reserved ? *reserved * 2 : NBT_WALK_INLINE_DEPTH;
+	if (grown > SIZE_MAX / size) {
+		return NULL;
+	}
+	void* moved;
+	if (inline_frames && frames == inline_frames) {
+		moved = malloc(size * grown);
+		if (moved) {
+			memcpy(moved, inline_frames, size * *reserved);
+		}
+	} else {
+		moved = realloc(frames, size * grown);
+	}
+	if (moved) {
+		*reserved = grown;
+	}
+	return moved;
+}
+
+bool _nbt_walk_descends(nbt_t* tag, nbt_walk_flags_t flags) {
+	if (tag->flags & NBT_FLAG_DEFERRED) {
+		/* Whatever's under it is still only in the source */
+		return false;
+	}
+	switch (tag->type) {
+		case NBT_COMPOUND:
+			return tag->payload.tag_compound.head != NULL;
+		case NBT_LIST:
+			return tag->payload.tag_list.count > 0 && (flags & NBT_WALK_PACKED_ELEMENTS || !(tag->flags & NBT_FLAG_PACKED));
+		default:
+			return false;
+	}
+}
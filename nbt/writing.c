@@ -29,10 +29,21 @@
 
 #include "internal.h"
 
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct nbt_write_state {
+	nbt_coder_t* coder;
+	nbt_byte_order_t order;
+};
 
 void _nbt_write_data(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order);
+nbt_walk_action_t _nbt_write_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context);
+nbt_walk_action_t _nbt_write_leave(nbt_t* tag, const nbt_walk_position_t* position, void* context);
 void _nbt_write_payload(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order);
+size_t _nbt_write_size(nbt_t* tag);
 
 nbt_coder_t* nbt_write_data(nbt_t* tag, nbt_byte_order_t order) {
 	nbt_coder_t* coder = nbt_coder_create();
@@ -40,68 +51,251 @@ nbt_coder_t* nbt_write_data(nbt_t* tag, nbt_byte_order_t order) {
 	return coder;
 }
 
+nbt_coder_t* nbt_write_compressed(nbt_t* tag, nbt_byte_order_t order, nbt_compression_strategy_t compression_strategy) {
+	nbt_coder_t* coder = nbt_coder_create();
+	nbt_coder_t* deflate = nbt_coder_create_deflate(coder, compression_strategy);
+	nbt_write_coder(tag, deflate, order);
+	nbt_coder_release(deflate);
+	return coder;
+}
+
+nbt_coder_t* nbt_context_write(nbt_context_t* context, nbt_t* tag, nbt_byte_order_t order) {
+	if (context->written) {
+		nbt_coder_reset(context->written);
+	} else {
+		context->written = nbt_coder_create();
+	}
+	_nbt_write_data(tag, context->written, order);
+	return context->written;
+}
+
+nbt_coder_t* nbt_context_write_compressed(nbt_context_t* context, nbt_t* tag, nbt_byte_order_t order, nbt_compression_strategy_t compression_strategy) {
+	return nbt_context_compress(context, nbt_context_write(context, tag, order), compression_strategy);
+}
+
+nbt_status_t nbt_write_coder(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order) {
+	_nbt_write_data(tag, coder, order);
+	return nbt_coder_finish(coder) ? NBT_SUCCESS : NBT_ERROR_IO;
+}
+
+nbt_status_t nbt_write_fd(nbt_t* tag, int fd, nbt_byte_order_t order, nbt_write_flags_t flags) {
+	nbt_coder_t* sink = nbt_coder_create_fd_sink(fd);
+	nbt_coder_t* coder = sink;
+	if (flags & (NBT_WRITE_GZIP | NBT_WRITE_ZLIB)) {
+		coder = nbt_coder_create_deflate(sink, flags & NBT_WRITE_GZIP ? NBT_COMPRESSION_GZIP : NBT_COMPRESSION_INFLATE);
+	}
+	/* Finishing the deflate sink flushes the fd sink under it */
+	nbt_status_t status = nbt_write_coder(tag, coder, order);
+	if (coder != sink) {
+		nbt_coder_release(coder);
+	}
+	nbt_coder_release(sink);
+	return status;
+}
+
+nbt_status_t nbt_write_file(nbt_t* tag, const char* path, nbt_byte_order_t order, nbt_write_flags_t flags) {
+	if (!(flags & NBT_WRITE_ATOMIC)) {
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			return NBT_ERROR_IO;
+		}
+		nbt_status_t status = nbt_write_fd(tag, fd, order, flags);
+		if (close(fd) && !status) {
+			status = NBT_ERROR_IO;
+		}
+		return status;
+	}
+	
+	/* The temporary has to be in the same directory for rename to be atomic */
+	char* temp_path = nbt_printf("%s.XXXXXX", path);
+	int fd = mkstemp(temp_path);
+	if (fd < 0) {
+		free(temp_path);
+		return NBT_ERROR_IO;
+	}
+	struct stat info;
+	fchmod(fd, stat(path, &info) ? 0644 : info.st_mode & 07777);
+	
+	nbt_status_t status = nbt_write_fd(tag, fd, order, flags);
+	if (!status && fsync(fd)) {
+		status = NBT_ERROR_IO;
+	}
+	if (close(fd) && !status) {
+		status = NBT_ERROR_IO;
+	}
+	if (!status && rename(temp_path, path)) {
+		status = NBT_ERROR_IO;
+	}
+	if (status) {
+		unlink(temp_path);
+	}
+	free(temp_path);
+	return status;
+}
+
 void _nbt_write_data(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order) {
-	nbt_coder_encode_byte(coder, tag->type);
-	nbt_coder_encode_short(coder, strlen(tag->name), order);
-	nbt_coder_encode_data(coder, tag->name, strlen(tag->name));
-	_nbt_write_payload(tag, coder, order);
+	struct nbt_write_state state = { coder, order };
+	/* Packed lists are written in one go, so the walk doesn't need their elements */
+	_nbt_walk(tag, _nbt_write_enter, _nbt_write_leave, &state, NBT_WALK_DEFERRED);
 }
 
-void _nbt_write_payload(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order) {
-	if (!tag) {
-		return;
+nbt_walk_action_t _nbt_write_enter(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	struct nbt_write_state* state = context;
+	nbt_coder_t* coder = state->coder;
+	const char* copy = NULL;
+	size_t size = 0;
+	if (tag->flags & NBT_FLAG_DEFERRED) {
+		/* Nobody's looked at it, so the input still says exactly what it holds */
+		nbt_byte_order_t order;
+		copy = _nbt_deferred_payload(tag, &size, &order);
+		if (order != state->order) {
+			_nbt_materialize(tag);
+			copy = NULL;
+		}
+	}
+	if (!copy) {
+		size = _nbt_write_size(tag);
 	}
+	if (!position->parent || position->parent->type == NBT_COMPOUND) {
+		/* List elements are just a payload */
+		size_t name_length = tag->name_length;
+		nbt_coder_reserve(coder, sizeof(int8_t) + sizeof(int16_t) + name_length + size);
+		nbt_coder_append_byte(coder, tag->type);
+		nbt_coder_append_short(coder, name_length, state->order);
+		nbt_coder_append_data(coder, _nbt_name_bytes(tag), name_length);
+	} else {
+		nbt_coder_reserve(coder, size);
+	}
+	if (copy) {
+		nbt_coder_append_data(coder, copy, size);
+		return NBT_WALK_SKIP;
+	}
+	_nbt_write_payload(tag, coder, state->order);
+	return NBT_WALK_CONTINUE;
+}
+
+nbt_walk_action_t _nbt_write_leave(nbt_t* tag, const nbt_walk_position_t* position, void* context) {
+	struct nbt_write_state* state = context;
+	/* A copied compound already ended with its END */
+	if (tag->type == NBT_COMPOUND && !(tag->flags & NBT_FLAG_DEFERRED)) {
+		nbt_coder_append_byte(state->coder, 0);
+	}
+	return NBT_WALK_CONTINUE;
+}
+
+/* Bytes a payload writes itself, not counting any children or the end of a compound */
+size_t _nbt_write_size(nbt_t* tag) {
+	switch (tag->type) {
+		case NBT_END:
+			return 0;
+		case NBT_BYTE:
+			return sizeof(int8_t);
+		case NBT_SHORT:
+			return sizeof(int16_t);
+		case NBT_INT:
+			return sizeof(int32_t);
+		case NBT_LONG:
+			return sizeof(int64_t);
+		case NBT_FLOAT:
+			return sizeof(float);
+		case NBT_DOUBLE:
+			return sizeof(double);
+		case NBT_BYTE_ARRAY:
+			return sizeof(int32_t) + tag->payload.tag_byte_array.length;
+		case NBT_INT_ARRAY:
+			return sizeof(int32_t) + sizeof(int32_t) * tag->payload.tag_int_array.length;
+		case NBT_LONG_ARRAY:
+			return sizeof(int32_t) + sizeof(int64_t) * tag->payload.tag_long_array.length;
+		case NBT_STRING:
+			return sizeof(int16_t) + tag->payload.tag_string.length;
+		case NBT_LIST:
+			return sizeof(int8_t) + sizeof(int32_t);
+		case NBT_COMPOUND:
+			return sizeof(int8_t);
+	}
+	return 0;
+}
+
+/* Everything up to the children, which the walk gets to next */
+void _nbt_write_payload(nbt_t* tag, nbt_coder_t* coder, nbt_byte_order_t order) {
 	switch (tag->type) {
 		case NBT_END:
 			break;
 		case NBT_BYTE:
-			nbt_coder_encode_byte(coder, tag->payload.tag_byte);
+			nbt_coder_append_byte(coder, tag->payload.tag_byte);
 			break;
 		case NBT_SHORT:
-			nbt_coder_encode_short(coder, tag->payload.tag_short, order);
+			nbt_coder_append_short(coder, tag->payload.tag_short, order);
 			break;
 		case NBT_INT:
-			nbt_coder_encode_int(coder, tag->payload.tag_int, order);
+			nbt_coder_append_int(coder, tag->payload.tag_int, order);
 			break;
 		case NBT_LONG:
-			nbt_coder_encode_long(coder, tag->payload.tag_long, order);
+			nbt_coder_append_long(coder, tag->payload.tag_long, order);
 			break;
 		case NBT_FLOAT:
-			nbt_coder_encode_float(coder, tag->payload.tag_float, order);
+			nbt_coder_append_float(coder, tag->payload.tag_float, order);
 			break;
 		case NBT_DOUBLE:
-			nbt_coder_encode_double(coder, tag->payload.tag_double, order);
+			nbt_coder_append_double(coder, tag->payload.tag_double, order);
 			break;
 		case NBT_BYTE_ARRAY:
-			nbt_coder_encode_int(coder, tag->payload.tag_byte_array.length, order);
-			nbt_coder_encode_data(coder, (const char*)tag->payload.tag_byte_array.byte_array, tag->payload.tag_byte_array.length);
+			nbt_coder_append_int(coder, tag->payload.tag_byte_array.length, order);
+			nbt_coder_append_data(coder, (const char*)tag->payload.tag_byte_array.byte_array, tag->payload.tag_byte_array.length);
 			break;
 		case NBT_INT_ARRAY:
-			nbt_coder_encode_int(coder, tag->payload.tag_int_array.length, order);
-			for (int32_t i = 0; i < tag->payload.tag_int_array.length; i++) {
-				nbt_coder_encode_int(coder, tag->payload.tag_int_array.int_array[i], order);
+			nbt_coder_append_int(coder, tag->payload.tag_int_array.length, order);
+			nbt_coder_append_ints(coder, tag->payload.tag_int_array.int_array, tag->payload.tag_int_array.length, order);
+			break;
+		case NBT_LONG_ARRAY: {
+			struct nbt_long_array* array = &tag->payload.tag_long_array;
+			nbt_coder_append_int(coder, array->length, order);
+			if (array->order == order) {
+				/* Already in the output order, forward the bytes untouched */
+				nbt_coder_append_data(coder, (const char*)array->long_array, sizeof(int64_t) * array->length);
+			} else {
+				/* One of the two orders is native, so reordering into the other one swaps */
+				nbt_byte_order_t foreign = array->order == nbt_native_byte_order ? order : array->order;
+				nbt_coder_append_longs(coder, array->long_array, array->length, foreign);
 			}
 			break;
-		case NBT_STRING:
-			nbt_coder_encode_short(coder, strlen(tag->payload.tag_string), order);
-			nbt_coder_encode_data(coder, tag->payload.tag_string, strlen(tag->payload.tag_string));
+		}
+		case NBT_STRING: {
+			size_t length = tag->payload.tag_string.length;
+			nbt_coder_append_short(coder, length, order);
+			nbt_coder_append_data(coder, _nbt_string_bytes(tag), length);
 			break;
+		}
 		case NBT_LIST: {
-			nbt_coder_encode_byte(coder, tag->payload.tag_list.type);
-			nbt_coder_encode_int(coder, _nbt_tree_count(tag->payload.tag_list.tree), order);
-			nbt_t* next = tag->payload.tag_list.tree;
-			do {
-				_nbt_write_payload(next, coder, order);
-			} while ((next = next->tree_right));
+			int32_t count = tag->payload.tag_list.count;
+			nbt_t** items = tag->payload.tag_list.elements.items;
+			nbt_coder_append_byte(coder, tag->element_type);
+			nbt_coder_append_int(coder, count, order);
+			if (tag->flags & NBT_FLAG_PACKED) {
+				const void* values = tag->payload.tag_list.elements.values;
+				switch (_nbt_packed_width(tag->element_type)) {
+					case sizeof(int8_t):
+						nbt_coder_append_data(coder, values, count);
+						break;
+					case sizeof(int16_t):
+						nbt_coder_append_shorts(coder, values, count, order);
+						break;
+					case sizeof(int32_t):
+						nbt_coder_append_ints(coder, values, count, order);
+						break;
+					case sizeof(int64_t):
+						nbt_coder_append_longs(coder, values, count, order);
+						break;
+				}
+				break;
+			}
+			if (count && items[0]->type <= NBT_DOUBLE) {
+				/* Fixed width elements can all be reserved at once */
+				nbt_coder_reserve(coder, count * _nbt_write_size(items[0]));
+			}
 			break;
 		}
-		case NBT_COMPOUND: {
-			nbt_t* next = tag->payload.tag_compound;
-			do {
-				_nbt_write_data(next, coder, order);
-			} while ((next = next->tree_right));
-			nbt_coder_encode_byte(coder, 0);
+		case NBT_COMPOUND:
 			break;
-		}
 	}
 }
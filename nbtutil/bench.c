@@ -0,0 +1,394 @@
+/*
+ *   ___    __ __  ____ ________
+ *  |   \  |  |  |/ _  \        |
+ *  |    \ |  |    (_) /__    __|
+ *  |  |\ \|  |     _  \  |  |
+ *  |  | \    |    (_) |  |  |
+ *  |__|  \___|__|\____/  |__|
+ *
+ *  bench.c
+ *  This file is part of nbt.
+ *
+ *  Created by Silas Schwarz on 10/18/26.
+ *  Copyright (c) 2016 ZCodeMT LLC.
+ *
+ *  nbt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nbt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nbt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "commands.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "nbt.h"
+
+/* Keep repeating a case until it has run for at least this long */
+#define BENCH_MIN_SECONDS 0.5
+
+static const struct option options[] = {
+	{ "path", required_argument, NULL, 'p' },
+	{ "size", required_argument, NULL, 's' },
+	{ NULL, 0, NULL, 0 }
+};
+
+typedef void (*bench_case_t)(nbt_coder_t* input);
+
+/* Cases that need a parsed tree share it through here */
+static nbt_t* bench_tree = NULL;
+
+/* Warmed up across iterations, like a worker thread's would be */
+static nbt_context_t* bench_context = NULL;
+
+double bench_now();
+void bench_run(const char* name, bench_case_t bench_case, nbt_coder_t* input, size_t bytes);
+nbt_coder_t* bench_synthetic(size_t megabytes);
+
+void bench_decompress_chunked(nbt_coder_t* input);
+void bench_decompress_hinted(nbt_coder_t* input);
+void bench_parse(nbt_coder_t* input);
+void bench_parse_arena(nbt_coder_t* input);
+void bench_parse_borrowed(nbt_coder_t* input);
+void bench_parse_parallel(nbt_coder_t* input);
+void bench_parse_interned(nbt_coder_t* input);
+void bench_parse_lazy(nbt_coder_t* input);
+void bench_parse_projected(nbt_coder_t* input);
+void bench_parse_events(nbt_coder_t* input);
+nbt_walk_action_t bench_count_event(const nbt_event_t* event, void* context);
+void bench_read(nbt_coder_t* input);
+void bench_validate(nbt_coder_t* input);
+void bench_write(nbt_coder_t* input);
+void bench_write_fd(nbt_coder_t* input);
+void bench_write_then_compress(nbt_coder_t* input);
+void bench_write_compressed(nbt_coder_t* input);
+void bench_compress(nbt_coder_t* input);
+void bench_round_trip(nbt_coder_t* input);
+void bench_round_trip_context(nbt_coder_t* input);
+void bench_compress_parallel(nbt_coder_t* input);
+
+void bench_suite(const char* title, nbt_coder_t* compressed);
+
+int bench_main(int argc, const char* argv[]) {
+	int option;
+	char* path = NULL;
+	size_t megabytes = 32;
+	int option_index;
+	while ((option = getopt_long(argc - 1, (char*const*)&argv[1], "p:s:", options, &option_index)) != -1) {
+		switch (option) {
+			case 'p':
+				path = strdup(optarg);
+				break;
+			case 's':
+				megabytes = strtoul(optarg, NULL, 10);
+				break;
+			case '?':
+				return 1;
+		}
+	}
+	optind = 1;
+
+	if (!path) {
+		path = strdup("test_data/level.nbt");
+	}
+	nbt_coder_t* coder = nbt_coder_create_mapped(path);
+	if (!coder) {
+		printf("Couldn't read %s\n", path);
+		free(path);
+		return 1;
+	}
+	bench_suite(path, coder);
+	nbt_coder_release(coder);
+	free(path);
+
+	size_t sizes[] = { 1, megabytes };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+		if (!sizes[i]) {
+			continue;
+		}
+		nbt_coder_t* synthetic = bench_synthetic(sizes[i]);
+		char* title = nbt_printf("synthetic %zu MB", sizes[i]);
+		bench_suite(title, synthetic);
+		free(title);
+		nbt_coder_release(synthetic);
+	}
+	return 0;
+}
+
+void bench_suite(const char* title, nbt_coder_t* compressed) {
+	nbt_coder_t* raw = nbt_coder_decompress(compressed);
+	size_t bytes = nbt_coder_size(raw);
+	nbt_status_t error = NBT_SUCCESS;
+	bench_tree = nbt_parse_coder(raw, NBT_BIG_ENDIAN, false, &error);
+	assert(!error);
+	bench_context = nbt_context_create();
+	printf("%s (%zu bytes compressed, %zu bytes raw)\n", title, nbt_coder_size(compressed), bytes);
+	bench_run("decompress, 128 byte chunks", bench_decompress_chunked, compressed, bytes);
+	bench_run("decompress, size hinted", bench_decompress_hinted, compressed, bytes);
+	bench_run("parse and save compressed", bench_round_trip, compressed, bytes);
+	bench_run("parse and save compressed, context", bench_round_trip_context, compressed, bytes);
+	bench_run("parse", bench_parse, raw, bytes);
+	bench_run("parse, arena", bench_parse_arena, raw, bytes);
+	bench_run("parse, borrowed payloads", bench_parse_borrowed, raw, bytes);
+	bench_run("parse, arena, parallel", bench_parse_parallel, raw, bytes);
+	bench_run("parse, interned names", bench_parse_interned, raw, bytes);
+	bench_run("parse, lazy, one field", bench_parse_lazy, raw, bytes);
+	bench_run("parse, projected to entity ids", bench_parse_projected, raw, bytes);
+	bench_run("parse events, counting tags", bench_parse_events, raw, bytes);
+	bench_run("read, counting tags", bench_read, raw, bytes);
+	bench_run("validate", bench_validate, raw, bytes);
+	bench_run("write", bench_write, raw, bytes);
+	bench_run("write, streamed to /dev/null", bench_write_fd, raw, bytes);
+	bench_run("write, then compress", bench_write_then_compress, raw, bytes);
+	bench_run("write, compressing", bench_write_compressed, raw, bytes);
+	bench_run("compress", bench_compress, raw, bytes);
+	bench_run("compress, parallel", bench_compress_parallel, raw, bytes);
+	nbt_release(bench_tree);
+	bench_tree = NULL;
+	nbt_context_release(bench_context);
+	bench_context = NULL;
+	nbt_coder_release(raw);
+}
+
+double bench_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void bench_run(const char* name, bench_case_t bench_case, nbt_coder_t* input, size_t bytes) {
+	size_t iterations = 0;
+	double start = bench_now();
+	double elapsed;
+	do {
+		bench_case(input);
+		iterations++;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SECONDS || iterations < 3);
+	double per_iteration = elapsed / iterations;
+	printf("\t%-32s %10.1f us/op %10.1f MB/s\n", name, per_iteration * 1e6, bytes / per_iteration / (1024 * 1024));
+}
+
+/* Roughly the shape of a region's worth of entities */
+nbt_coder_t* bench_synthetic(size_t megabytes) {
+	nbt_t* root = nbt_create_compound("");
+	nbt_t* entities = nbt_create_list("Entities", NBT_COMPOUND);
+	int32_t heightmap[256];
+	size_t target = megabytes * 1024 * 1024;
+	size_t written = 0;
+	for (int32_t i = 0; written < target; i++) {
+		nbt_t* entity = nbt_create_compound(NULL);
+		nbt_compound_set(entity, nbt_create_string("id", i % 3 ? "Zombie" : "Skeleton"));
+		nbt_compound_set(entity, nbt_create_short("Health", i % 20));
+		nbt_compound_set(entity, nbt_create_long("UUIDMost", (int64_t)i * 0x9E3779B97F4A7C15));
+		nbt_t* pos = nbt_create_list("Pos", NBT_DOUBLE);
+		nbt_list_add(pos, nbt_create_double(NULL, i * 0.5));
+		nbt_list_add(pos, nbt_create_double(NULL, 64.0));
+		nbt_list_add(pos, nbt_create_double(NULL, -i * 0.25));
+		nbt_compound_set(entity, pos);
+		for (int32_t j = 0; j < 256; j++) {
+			heightmap[j] = 60 + (i * 31 + j * 7) % 16;
+		}
+		nbt_compound_set(entity, nbt_create_int_array("HeightMap", heightmap, 256));
+		nbt_list_add(entities, entity);
+		written += 1024 + 150;
+	}
+	nbt_compound_set(root, entities);
+	nbt_coder_t* raw = nbt_write_data(root, NBT_BIG_ENDIAN);
+	nbt_coder_t* compressed = nbt_coder_compress(raw, NBT_COMPRESSION_GZIP);
+	nbt_coder_release(raw);
+	nbt_release(root);
+	return compressed;
+}
+
+/* What nbt_coder_decompress used to do: 128 byte inflate calls into a doubling buffer */
+void bench_decompress_chunked(nbt_coder_t* input) {
+	z_stream stream = {
+		.zalloc		= Z_NULL,
+		.zfree		= Z_NULL,
+		.opaque		= Z_NULL,
+		.next_in	= (Bytef*)nbt_coder_data(input),
+		.avail_in	= (uInt)nbt_coder_size(input)
+	};
+	int zlib_ret = inflateInit2(&stream, 15 + 32);
+	assert(zlib_ret == Z_OK);
+	size_t reserved = 128;
+	size_t size = 0;
+	char* data = malloc(reserved);
+	do {
+		if (reserved < size + 128) {
+			do {
+				reserved <<= 1;
+			} while (reserved < size + 128);
+			data = realloc(data, reserved);
+		}
+		stream.avail_out = 128;
+		stream.next_out = (Bytef*)data + size;
+		zlib_ret = inflate(&stream, Z_NO_FLUSH);
+		assert(zlib_ret == Z_OK || zlib_ret == Z_STREAM_END);
+		size += 128 - stream.avail_out;
+	} while (stream.avail_out == 0);
+	inflateEnd(&stream);
+	free(data);
+}
+
+void bench_decompress_hinted(nbt_coder_t* input) {
+	nbt_coder_release(nbt_coder_decompress(input));
+}
+
+void bench_parse(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_release(nbt_parse_data(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &error));
+}
+
+void bench_parse_arena(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .flags = NBT_PARSE_ARENA };
+	nbt_release(nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error));
+}
+
+void bench_parse_borrowed(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .flags = NBT_PARSE_BORROW };
+	nbt_release(nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error));
+}
+
+void bench_parse_parallel(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .flags = NBT_PARSE_ARENA | NBT_PARSE_PARALLEL };
+	nbt_release(nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error));
+}
+
+void bench_parse_interned(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .flags = NBT_PARSE_INTERN };
+	nbt_release(nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error));
+}
+
+/* The synthetic data's first entity id, level.dat only gets its root decoded */
+void bench_parse_lazy(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .flags = NBT_PARSE_LAZY };
+	nbt_t* tag = nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error);
+	nbt_t* entities = nbt_compound_name(tag, "Entities");
+	if (entities && nbt_list_count(entities)) {
+		nbt_compound_name(nbt_list_index(entities, 0), "id");
+	}
+	nbt_release(tag);
+}
+
+void bench_parse_projected(nbt_coder_t* input) {
+	static nbt_projection_t* projection = NULL;
+	if (!projection) {
+		const char* paths[] = { "Entities.id" };
+		projection = nbt_projection_create(paths, 1);
+	}
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_parse_options_t options = { .projection = projection };
+	nbt_release(nbt_parse_data_options(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, &options, &error));
+}
+
+void bench_parse_events(nbt_coder_t* input) {
+	size_t count = 0;
+	nbt_parse_events(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, false, bench_count_event, &count);
+}
+
+nbt_walk_action_t bench_count_event(const nbt_event_t* event, void* context) {
+	(*(size_t*)context)++;
+	return NBT_WALK_CONTINUE;
+}
+
+void bench_read(nbt_coder_t* input) {
+	nbt_coder_t* view = nbt_coder_create_borrowed(nbt_coder_data(input), nbt_coder_size(input));
+	nbt_reader_t* reader = nbt_reader_create(view, NBT_BIG_ENDIAN);
+	nbt_reader_tag_t tag;
+	size_t count = 0, depth = 0;
+	while (true) {
+		if (nbt_reader_next(reader, &tag)) {
+			count++;
+			if (tag.type == NBT_COMPOUND || tag.type == NBT_LIST) {
+				nbt_reader_enter(reader, NULL, NULL);
+				depth++;
+			} else {
+				nbt_reader_skip(reader);
+			}
+		} else if (depth) {
+			nbt_reader_leave(reader);
+			depth--;
+		} else {
+			break;
+		}
+	}
+	assert(!nbt_reader_status(reader));
+	nbt_reader_release(reader);
+	nbt_coder_release(view);
+}
+
+void bench_validate(nbt_coder_t* input) {
+	nbt_status_t status = nbt_validate(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, NULL, NULL);
+	assert(!status);
+	(void)status;
+}
+
+void bench_write(nbt_coder_t* input) {
+	nbt_coder_release(nbt_write_data(bench_tree, NBT_BIG_ENDIAN));
+}
+
+void bench_write_fd(nbt_coder_t* input) {
+	int fd = open("/dev/null", O_WRONLY);
+	assert(fd >= 0);
+	nbt_status_t status = nbt_write_fd(bench_tree, fd, NBT_BIG_ENDIAN, 0);
+	assert(!status);
+	(void)status;
+	close(fd);
+}
+
+void bench_write_then_compress(nbt_coder_t* input) {
+	nbt_coder_t* raw = nbt_write_data(bench_tree, NBT_BIG_ENDIAN);
+	nbt_coder_release(nbt_coder_compress(raw, NBT_COMPRESSION_GZIP));
+	nbt_coder_release(raw);
+}
+
+void bench_write_compressed(nbt_coder_t* input) {
+	nbt_coder_release(nbt_write_compressed(bench_tree, NBT_BIG_ENDIAN, NBT_COMPRESSION_GZIP));
+}
+
+void bench_compress(nbt_coder_t* input) {
+	nbt_coder_release(nbt_coder_compress(input, NBT_COMPRESSION_GZIP));
+}
+
+void bench_compress_parallel(nbt_coder_t* input) {
+	nbt_coder_release(nbt_coder_compress_parallel(input, NBT_COMPRESSION_GZIP, 0));
+}
+
+/* A chunk worker's loop: inflate, parse, write and deflate again */
+void bench_round_trip(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_t* tag = nbt_parse_data(nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, true, &error);
+	nbt_coder_t* raw = nbt_write_data(tag, NBT_BIG_ENDIAN);
+	nbt_coder_release(nbt_coder_compress(raw, NBT_COMPRESSION_GZIP));
+	nbt_coder_release(raw);
+	nbt_release(tag);
+}
+
+void bench_round_trip_context(nbt_coder_t* input) {
+	nbt_status_t error = NBT_SUCCESS;
+	nbt_t* tag = nbt_context_parse(bench_context, nbt_coder_data(input), nbt_coder_size(input), NBT_BIG_ENDIAN, true, &error);
+	nbt_context_write_compressed(bench_context, tag, NBT_BIG_ENDIAN, NBT_COMPRESSION_GZIP);
+	nbt_release(tag);
+}
@@ -37,6 +37,7 @@ __BEGIN_DECLS
 int dump_main(int argc, const char* argv[]);
 int edit_main(int argc, const char* argv[]);
 int help_main(int argc, const char* argv[]);
+int bench_main(int argc, const char* argv[]);
 
 __END_DECLS
 
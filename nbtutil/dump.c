@@ -106,8 +106,12 @@ int dump_main(int argc, const char* argv[]) {
 		}
 		free(endian);
 	}
-	nbt_coder_t* coder = nbt_coder_create_file(path);
+	nbt_coder_t* coder = nbt_coder_create_mapped(path);
 	free(path);
+	if (!coder) {
+		printf("Couldn't read the file\n");
+		return 1;
+	}
 	nbt_status_t error = NBT_SUCCESS;
 	nbt_t* tag = nbt_parse_coder(coder, order, compressed, &error);
 	nbt_coder_release(coder);
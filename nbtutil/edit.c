@@ -114,8 +114,13 @@ int edit_main(int argc, const char* argv[]) {
 		}
 		free(endian);
 	}
-	nbt_coder_t* coder = nbt_coder_create_file(path);
+	nbt_coder_t* coder = nbt_coder_create_mapped(path);
 	free(path);
+	if (!coder) {
+		printf("Couldn't read the file\n");
+		free(output);
+		return 1;
+	}
 	nbt_status_t error = NBT_SUCCESS;
 	nbt_t* tag = nbt_parse_coder(coder, order, compressed, &error);
 	nbt_coder_release(coder);
@@ -127,6 +132,9 @@ int edit_main(int argc, const char* argv[]) {
 	
 	if (!no_output) {
 		printf("Outputting...\n");
+		if (nbt_write_file(tag, output, order, NBT_WRITE_ATOMIC | (compressed ? NBT_WRITE_GZIP : 0))) {
+			printf("Couldn't write %s\n", output);
+		}
 	}
 	
 	nbt_release(tag);
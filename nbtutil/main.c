@@ -45,6 +45,8 @@ int main(int argc, const char * argv[]) {
 		return help_main(argc, argv);
 	} else if (!strcmp(argv[1], "edit")) {
 		return edit_main(argc, argv);
+	} else if (!strcmp(argv[1], "bench")) {
+		return bench_main(argc, argv);
 	} else {
 		printf("Unknown command: %s\n", argv[1]);
 		usage(argv[0]);
@@ -59,6 +61,7 @@ void usage(const char* command_call) {
 		   "\tCommands:\n"
 		   "\t\thelp [-c <command>]\t\tshow this message, or help for a specific command\n"
 		   "\t\tedit -p <path> \t\t\tenter an interactive mode for editing nbt data\n"
-		   "\t\tdump -p <path> [-s <style]\tdump a readable form of the nbt data at <path>\n",
+		   "\t\tdump -p <path> [-s <style]\tdump a readable form of the nbt data at <path>\n"
+		   "\t\tbench [-p <path>] [-s <MB>]\ttime the library on <path> and on generated data\n",
 		   command_call);
 }